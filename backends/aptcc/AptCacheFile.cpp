@@ -19,9 +19,13 @@
  */
 #include "AptCacheFile.h"
 
+#include "AptSharedCache.h"
 #include "apt-utils.h"
 #include "apt-messages.h"
 #include "OpPackageKitProgress.h"
+#include "ReverseDepends.h"
+#include "DescriptionCorpus.h"
+#include "GstCapsIndex.h"
 
 #include <apt-pkg/algorithms.h>
 #include <sstream>
@@ -29,8 +33,19 @@
 
 AptCacheFile::AptCacheFile(PkBackendJob *job) :
     m_packageRecords(0),
+    m_shared(0),
+    m_reverseDepends(0),
+    m_descriptions(0),
+    m_gstCaps(0),
     m_job(job)
 {
+    // The descriptions are picked by the job's locale, the
+    // process one is shared with the jobs running in parallel
+    gchar *locale = pk_backend_job_get_locale(job);
+    if (locale) {
+        m_locale = locale;
+    }
+    g_free(locale);
 }
 
 AptCacheFile::~AptCacheFile()
@@ -41,14 +56,56 @@ AptCacheFile::~AptCacheFile()
 bool AptCacheFile::Open(bool withLock)
 {
     OpPackageKitProgress progress(m_job);
-    return pkgCacheFile::Open(&progress, withLock);
+    AptSharedCache::lockBuild();
+    bool ret = pkgCacheFile::Open(&progress, withLock);
+    AptSharedCache::unlockBuild();
+    return ret;
+}
+
+bool AptCacheFile::OpenShared()
+{
+    m_shared = AptSharedCache::ref(m_job);
+    if (m_shared == 0) {
+        return false;
+    }
+
+    // Borrow everything from the shared cache, the package
+    // records are not thread safe so those stay private
+    Cache = m_shared->GetPkgCache();
+    Policy = m_shared->GetPolicy();
+    DCache = m_shared->GetDepCache();
+    SrcList = m_shared->GetSourceList();
+
+    return true;
+}
+
+bool AptCacheFile::isShared() const
+{
+    return m_shared != 0;
 }
 
 void AptCacheFile::Close()
 {
     delete m_packageRecords;
+    delete m_reverseDepends;
+    delete m_descriptions;
+    delete m_gstCaps;
 
     m_packageRecords = 0;
+    m_reverseDepends = 0;
+    m_descriptions = 0;
+    m_gstCaps = 0;
+
+    if (m_shared) {
+        // These belong to the shared cache, don't let pkgCacheFile delete them
+        Cache = 0;
+        Policy = 0;
+        DCache = 0;
+        SrcList = 0;
+
+        m_shared->unref();
+        m_shared = 0;
+    }
 
     pkgCacheFile::Close();
 
@@ -60,7 +117,10 @@ void AptCacheFile::Close()
 bool AptCacheFile::BuildCaches(bool withLock)
 {
     OpPackageKitProgress progress(m_job);
-    return pkgCacheFile::BuildCaches(&progress, withLock);
+    AptSharedCache::lockBuild();
+    bool ret = pkgCacheFile::BuildCaches(&progress, withLock);
+    AptSharedCache::unlockBuild();
+    return ret;
 }
 
 bool AptCacheFile::CheckDeps(bool AllowBroken)
@@ -405,13 +465,52 @@ pkgCache::VerIterator AptCacheFile::findCandidateVer(const pkgCache::PkgIterator
     return (*this)[pkg].CandidateVerIter(*this);
 }
 
+const ReverseDepends& AptCacheFile::reverseDepends()
+{
+    if (m_shared) {
+        return m_shared->reverseDepends();
+    }
+
+    if (m_reverseDepends == 0) {
+        GetDepCache();
+        m_reverseDepends = new ReverseDepends(*this);
+    }
+    return *m_reverseDepends;
+}
+
+const DescriptionCorpus& AptCacheFile::descriptions()
+{
+    if (m_shared) {
+        return m_shared->descriptions(m_locale);
+    }
+
+    if (m_descriptions == 0) {
+        GetDepCache();
+        m_descriptions = new DescriptionCorpus(*this, m_locale);
+    }
+    return *m_descriptions;
+}
+
+const GstCapsIndex& AptCacheFile::gstCaps()
+{
+    if (m_shared) {
+        return m_shared->gstCaps();
+    }
+
+    if (m_gstCaps == 0) {
+        GetDepCache();
+        m_gstCaps = new GstCapsIndex(*this);
+    }
+    return *m_gstCaps;
+}
+
 std::string AptCacheFile::getShortDescription(const pkgCache::VerIterator &ver)
 {
     if (ver.end() || ver.FileList().end() || GetPkgRecords() == 0) {
         return string();
     }
 
-    pkgCache::DescIterator d = ver.TranslatedDescription();
+    pkgCache::DescIterator d = findDescription(ver, m_locale);
     if (d.end()) {
         return string();
     }
@@ -430,7 +529,7 @@ std::string AptCacheFile::getLongDescription(const pkgCache::VerIterator &ver)
         return string();
     }
 
-    pkgCache::DescIterator d = ver.TranslatedDescription();
+    pkgCache::DescIterator d = findDescription(ver, m_locale);
     if (d.end()) {
         return string();
     }
@@ -24,6 +24,10 @@
 #include <pk-backend.h>
 
 class pkgProblemResolver;
+class AptSharedCache;
+class ReverseDepends;
+class DescriptionCorpus;
+class GstCapsIndex;
 class AptCacheFile : public pkgCacheFile
 {
 public:
@@ -35,6 +39,18 @@ public:
       */
     bool Open(bool withLock = false);
 
+    /**
+      * Uses the backend wide read-only cache instead of opening a
+      * private one, returning false if it can't be opened
+      * @note packages must not be marked on a shared cache
+      */
+    bool OpenShared();
+
+    /**
+      * Returns true if this cache is the backend wide read-only one
+      */
+    bool isShared() const;
+
     /**
       * Closes the package cache
       */
@@ -111,6 +127,24 @@ public:
      */
     pkgCache::VerIterator findVer(const pkgCache::PkgIterator &pkg);
 
+    /**
+     * Returns which packages depend on which, the index is built
+     * once per cache, shared caches share it with all their jobs
+     */
+    const ReverseDepends& reverseDepends();
+
+    /**
+     * Returns the lowercase long descriptions of all packages,
+     * read once per cache like reverseDepends()
+     */
+    const DescriptionCorpus& descriptions();
+
+    /**
+     * Returns the Gstreamer-* fields of all packages,
+     * read once per cache like reverseDepends()
+     */
+    const GstCapsIndex& gstCaps();
+
     /** \return a short description string corresponding to the given
      *  version.
      */
@@ -138,7 +172,12 @@ private:
     static std::string debParser(std::string descr);
 
     pkgRecords *m_packageRecords;
+    AptSharedCache *m_shared;
+    ReverseDepends *m_reverseDepends;
+    DescriptionCorpus *m_descriptions;
+    GstCapsIndex *m_gstCaps;
     PkBackendJob *m_job;
+    std::string m_locale;
 };
 
 #endif // APTCACHEFILE_H
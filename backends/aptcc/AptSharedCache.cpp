@@ -0,0 +1,277 @@
+/* AptSharedCache.cpp
+ *
+ * Copyright (c) 2014 PackageKit contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#include "AptSharedCache.h"
+
+#include "OpPackageKitProgress.h"
+#include "ReverseDepends.h"
+#include "DescriptionCorpus.h"
+#include "GstCapsIndex.h"
+
+#include <apt-pkg/algorithms.h>
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/error.h>
+
+#include <sys/stat.h>
+#include <cstdio>
+
+// The cache all new read-only jobs get, older ones stay
+// alive until the last job using them drops its reference
+static AptSharedCache *s_current = 0;
+static GMutex s_mutex;
+
+// Only one job that changes the system runs at a time
+static bool s_writing = false;
+static GMutex s_writerMutex;
+static GCond s_writerCond;
+
+static GMutex s_buildMutex;
+
+static GMutex s_acquireMutex;
+
+AptSharedCache::AptSharedCache(const std::string &stamp) :
+    m_stamp(stamp),
+    m_refCount(1),
+    m_reverseDepends(0),
+    m_gstCaps(0)
+{
+    g_mutex_init(&m_indexMutex);
+}
+
+AptSharedCache::~AptSharedCache()
+{
+    delete m_reverseDepends;
+    std::map<std::string, DescriptionCorpus*>::iterator it;
+    for (it = m_descriptions.begin(); it != m_descriptions.end(); ++it) {
+        delete it->second;
+    }
+    delete m_gstCaps;
+    g_mutex_clear(&m_indexMutex);
+
+    Close();
+}
+
+static bool isWriting()
+{
+    bool ret;
+    g_mutex_lock(&s_writerMutex);
+    ret = s_writing;
+    g_mutex_unlock(&s_writerMutex);
+    return ret;
+}
+
+AptSharedCache* AptSharedCache::ref(PkBackendJob *job)
+{
+    const std::string stamp = currentStamp();
+
+    g_mutex_lock(&s_mutex);
+    if (s_current && isWriting()) {
+        // Keep using the last snapshot until the system is consistent again
+    } else if (s_current && s_current->m_stamp != stamp) {
+        g_debug("Package cache changed on disk, reopening the shared cache");
+        s_current->unref();
+        s_current = 0;
+    }
+
+    if (s_current == 0) {
+        AptSharedCache *cache = new AptSharedCache(stamp);
+        if (!cache->open(job)) {
+            g_mutex_unlock(&s_mutex);
+            delete cache;
+            return 0;
+        }
+        s_current = cache;
+    }
+
+    AptSharedCache *ret = s_current;
+    g_atomic_int_inc(&ret->m_refCount);
+    g_mutex_unlock(&s_mutex);
+
+    return ret;
+}
+
+void AptSharedCache::unref()
+{
+    if (g_atomic_int_dec_and_test(&m_refCount)) {
+        delete this;
+    }
+}
+
+void AptSharedCache::invalidate()
+{
+    g_mutex_lock(&s_mutex);
+    if (s_current) {
+        s_current->unref();
+        s_current = 0;
+    }
+    g_mutex_unlock(&s_mutex);
+}
+
+bool AptSharedCache::lockWriter(PkBackendJob *job, const gint &cancelled)
+{
+    g_mutex_lock(&s_writerMutex);
+    while (s_writing) {
+        pk_backend_job_set_status(job, PK_STATUS_ENUM_WAITING_FOR_LOCK);
+
+        // wake up once in a while to see if the job was cancelled
+        gint64 endTime = g_get_monotonic_time() + G_TIME_SPAN_SECOND;
+        g_cond_wait_until(&s_writerCond, &s_writerMutex, endTime);
+        if (g_atomic_int_get(&cancelled)) {
+            g_mutex_unlock(&s_writerMutex);
+            return false;
+        }
+    }
+    s_writing = true;
+    g_mutex_unlock(&s_writerMutex);
+
+    // Tell the daemon no other exclusive transaction may run now
+    pk_backend_job_set_locked(job, true);
+
+    return true;
+}
+
+void AptSharedCache::unlockWriter()
+{
+    g_mutex_lock(&s_writerMutex);
+    s_writing = false;
+    g_cond_signal(&s_writerCond);
+    g_mutex_unlock(&s_writerMutex);
+}
+
+void AptSharedCache::lockBuild()
+{
+    g_mutex_lock(&s_buildMutex);
+}
+
+void AptSharedCache::unlockBuild()
+{
+    g_mutex_unlock(&s_buildMutex);
+}
+
+void AptSharedCache::lockAcquire()
+{
+    g_mutex_lock(&s_acquireMutex);
+}
+
+void AptSharedCache::unlockAcquire()
+{
+    g_mutex_unlock(&s_acquireMutex);
+}
+
+const ReverseDepends& AptSharedCache::reverseDepends()
+{
+    g_mutex_lock(&m_indexMutex);
+    if (m_reverseDepends == 0) {
+        m_reverseDepends = new ReverseDepends(*this);
+    }
+    g_mutex_unlock(&m_indexMutex);
+
+    return *m_reverseDepends;
+}
+
+const DescriptionCorpus& AptSharedCache::descriptions(const std::string &locale)
+{
+    g_mutex_lock(&m_indexMutex);
+    DescriptionCorpus *&descriptions = m_descriptions[locale];
+    if (descriptions == 0) {
+        descriptions = new DescriptionCorpus(*this, locale);
+    }
+    g_mutex_unlock(&m_indexMutex);
+
+    return *descriptions;
+}
+
+const GstCapsIndex& AptSharedCache::gstCaps()
+{
+    g_mutex_lock(&m_indexMutex);
+    if (m_gstCaps == 0) {
+        m_gstCaps = new GstCapsIndex(*this);
+    }
+    g_mutex_unlock(&m_indexMutex);
+
+    return *m_gstCaps;
+}
+
+bool AptSharedCache::open(PkBackendJob *job)
+{
+    OpPackageKitProgress progress(job);
+    lockBuild();
+    bool ret = pkgCacheFile::Open(&progress, false);
+    unlockBuild();
+    if (ret == false) {
+        // The private cache will report the errors to the job
+        _error->Discard();
+        return false;
+    }
+
+    // Build everything that is otherwise built on demand now,
+    // the jobs only ever read from it
+    if (BuildSourceList() == false) {
+        _error->Discard();
+        return false;
+    }
+
+    // Apply corrections for half-installed packages, if something is
+    // broken let the private cache try to fix it and report
+    if (pkgApplyStatus(*DCache) == false || DCache->BrokenCount() != 0) {
+        _error->Discard();
+        return false;
+    }
+
+    return true;
+}
+
+static void appendFileStamp(std::string &stamp, const std::string &path)
+{
+    struct stat buf;
+    char str[128];
+
+    if (stat(path.c_str(), &buf) != 0) {
+        stamp.append("-;");
+        return;
+    }
+
+    // Directories change their mtime when an entry is renamed in or removed
+    snprintf(str, sizeof(str), "%lu:%lld:%ld.%09ld;",
+             (unsigned long) buf.st_ino,
+             (long long) buf.st_size,
+             (long) buf.st_mtim.tv_sec,
+             (long) buf.st_mtim.tv_nsec);
+    stamp.append(str);
+}
+
+std::string AptSharedCache::currentStamp()
+{
+    std::string stamp;
+
+    // dpkg status and what was automatically installed
+    appendFileStamp(stamp, _config->FindFile("Dir::State::status"));
+    appendFileStamp(stamp, _config->FindFile("Dir::State::extended_states"));
+
+    // the downloaded package lists
+    appendFileStamp(stamp, _config->FindDir("Dir::State::Lists"));
+
+    // the sources list and the pinning, which changes the candidates
+    appendFileStamp(stamp, _config->FindFile("Dir::Etc::sourcelist"));
+    appendFileStamp(stamp, _config->FindDir("Dir::Etc::sourceparts"));
+    appendFileStamp(stamp, _config->FindFile("Dir::Etc::preferences"));
+    appendFileStamp(stamp, _config->FindDir("Dir::Etc::preferencesparts"));
+
+    return stamp;
+}
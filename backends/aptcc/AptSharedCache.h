@@ -0,0 +1,127 @@
+/* AptSharedCache.h
+ *
+ * Copyright (c) 2014 PackageKit contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#ifndef APTSHAREDCACHE_H
+#define APTSHAREDCACHE_H
+
+#include <apt-pkg/cachefile.h>
+#include <pk-backend.h>
+
+#include <map>
+#include <string>
+
+class ReverseDepends;
+class DescriptionCorpus;
+class GstCapsIndex;
+/**
+ * A read-only package cache shared by all the jobs that don't need
+ * to lock or mark packages, it is opened once and only reopened
+ * when one of the files it was built from changes
+ */
+class AptSharedCache : public pkgCacheFile
+{
+public:
+    /**
+      * Returns a reference to the current cache, (re)opening it if
+      * the dpkg status, the package lists or the sources changed
+      * @returns NULL if the cache could not be opened, in that case
+      * a private cache should be used so the errors get reported
+      */
+    static AptSharedCache* ref(PkBackendJob *job);
+
+    /**
+      * Releases a reference returned by ref()
+      */
+    void unref();
+
+    /**
+      * Makes the next ref() open a new cache
+      */
+    static void invalidate();
+
+    /**
+      * Waits until no other job that changes the system is running,
+      * while the lock is held the shared cache is not reopened so
+      * read-only jobs keep working on the last snapshot
+      * @returns false if the job was cancelled while waiting
+      */
+    static bool lockWriter(PkBackendJob *job, const gint &cancelled);
+
+    /**
+      * Releases the lock taken with lockWriter()
+      */
+    static void unlockWriter();
+
+    /**
+      * apt can't generate its cache files from two threads at
+      * once, so this must be held around building a cache
+      */
+    static void lockBuild();
+    static void unlockBuild();
+
+    /**
+      * The acquire settings in _config (the proxies) are changed
+      * for each job that downloads, the job must hold this from
+      * setting them until its fetchers are done
+      */
+    static void lockAcquire();
+    static void unlockAcquire();
+
+    /**
+      * Returns the reverse dependencies of this cache,
+      * built by the first job asking for them
+      */
+    const ReverseDepends& reverseDepends();
+
+    /**
+      * Returns the lowercase descriptions of this cache in the
+      * language of locale, read by the first job searching the
+      * details in that language
+      */
+    const DescriptionCorpus& descriptions(const std::string &locale);
+
+    /**
+      * Returns the GStreamer fields of this cache,
+      * read by the first job looking for a codec
+      */
+    const GstCapsIndex& gstCaps();
+
+private:
+    AptSharedCache(const std::string &stamp);
+    ~AptSharedCache();
+
+    bool open(PkBackendJob *job);
+
+    /**
+      * Returns a string that changes whenever one of
+      * the files the cache is built from changes
+      */
+    static std::string currentStamp();
+
+    std::string m_stamp;
+    volatile gint m_refCount;
+
+    // Guards the indexes built on demand
+    GMutex m_indexMutex;
+    ReverseDepends *m_reverseDepends;
+    std::map<std::string, DescriptionCorpus*> m_descriptions;
+    GstCapsIndex *m_gstCaps;
+};
+
+#endif // APTSHAREDCACHE_H
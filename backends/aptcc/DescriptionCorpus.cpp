@@ -0,0 +1,63 @@
+/* DescriptionCorpus.cpp
+ *
+ * Copyright (c) 2014 PackageKit contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#include "DescriptionCorpus.h"
+
+#include "apt-utils.h"
+
+#include <apt-pkg/pkgrecords.h>
+
+#include <cstring>
+
+DescriptionCorpus::DescriptionCorpus(pkgCacheFile &cache, const std::string &locale)
+{
+    pkgCache *pkgcache = cache.GetPkgCache();
+    const unsigned int packageCount = pkgcache->HeaderP->PackageCount;
+    pkgRecords records(*pkgcache);
+
+    // Every description ends with a NUL so regexec() can use it as is,
+    // packages without one point to the first NUL
+    m_offsets.assign(packageCount, 0);
+    m_text.push_back('\0');
+    for (pkgCache::PkgIterator pkg = pkgcache->PkgBegin(); !pkg.end(); ++pkg) {
+        const pkgCache::VerIterator &ver = findVer(cache, pkg);
+        if (ver.end() || ver.FileList().end()) {
+            continue;
+        }
+
+        pkgCache::DescIterator d = findDescription(ver, locale);
+        if (d.end() || d.FileList().end()) {
+            continue;
+        }
+
+        const std::string &description = records.Lookup(d.FileList()).LongDesc();
+        m_offsets[pkg->ID] = m_text.size();
+        for (std::string::const_iterator it = description.begin(); it != description.end(); ++it) {
+            m_text.push_back(g_ascii_tolower(*it));
+        }
+        m_text.push_back('\0');
+    }
+}
+
+const char* DescriptionCorpus::description(const pkgCache::PkgIterator &pkg, size_t &length) const
+{
+    const char *text = m_text.data() + m_offsets[pkg->ID];
+    length = strlen(text);
+    return text;
+}
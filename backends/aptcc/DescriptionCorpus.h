@@ -0,0 +1,55 @@
+/* DescriptionCorpus.h
+ *
+ * Copyright (c) 2014 PackageKit contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#ifndef DESCRIPTIONCORPUS_H
+#define DESCRIPTIONCORPUS_H
+
+#include <apt-pkg/cachefile.h>
+
+#include <string>
+#include <vector>
+
+/**
+ * The long descriptions of all packages in lowercase, read from the
+ * package records once per cache so searching the details doesn't need
+ * a record lookup and a string copy per package
+ */
+class DescriptionCorpus
+{
+public:
+    /**
+      * Reads the descriptions in the language of locale, see
+      * findDescription(), the cache must not change afterwards
+      */
+    DescriptionCorpus(pkgCacheFile &cache, const std::string &locale);
+
+    /**
+      * Returns the NUL terminated description of the version
+      * AptCacheFile::findVer() picks for pkg, ASCII letters are
+      * in lowercase, empty if the package has no description
+      */
+    const char* description(const pkgCache::PkgIterator &pkg, size_t &length) const;
+
+private:
+    // the description of package id starts at m_text[m_offsets[id]]
+    std::vector<size_t> m_offsets;
+    std::string m_text;
+};
+
+#endif // DESCRIPTIONCORPUS_H
@@ -0,0 +1,439 @@
+/* DpkgFileIndex.cpp
+ *
+ * Copyright (c) 2014 PackageKit contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#include "DpkgFileIndex.h"
+
+#include "apt-utils.h"
+
+#include <apt-pkg/configuration.h>
+
+#include <sys/mman.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+
+#define DPKG_INFO_DIR    "/var/lib/dpkg/info/"
+#define INDEX_FILE_NAME  "pkgfiles.bin"
+// "PKF1", bump it whenever the layout changes
+#define INDEX_MAGIC      0x31464b50
+
+using std::string;
+using std::vector;
+
+/*
+ * The index file is the header followed by the packages sorted
+ * by name, the paths sorted by hash and the strings, which hold
+ * the names and the .list files as they were read.
+ */
+struct IndexHeader
+{
+    guint32 magic;
+    guint32 packageCount;
+    guint64 pathCount;
+    guint64 stringsSize;
+    gint64 dirMtimeSec;
+    gint64 dirMtimeNsec;
+};
+
+struct IndexPackage
+{
+    guint64 name;
+    guint64 contents;
+    guint64 contentsSize;
+    gint64 mtimeSec;
+    gint64 mtimeNsec;
+    guint32 nameSize;
+    guint32 padding;
+};
+
+struct IndexPath
+{
+    guint64 hash;
+    guint64 path;
+    guint32 pathSize;
+    guint32 package;
+};
+
+// A .list file while building the index
+struct ListFile
+{
+    string name;
+    string contents;
+    struct stat info;
+
+    bool operator<(const ListFile &other) const { return name < other.name; }
+};
+
+static DpkgFileIndex *s_current = 0;
+static GMutex s_mutex;
+
+// FNV-1a
+static guint64 hashPath(const char *path, size_t size)
+{
+    guint64 hash = G_GUINT64_CONSTANT(14695981039346656037);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<guchar>(path[i]);
+        hash *= G_GUINT64_CONSTANT(1099511628211);
+    }
+    return hash;
+}
+
+static bool pathLess(const IndexPath &a, const IndexPath &b)
+{
+    return a.hash < b.hash;
+}
+
+DpkgFileIndex::DpkgFileIndex() :
+    m_data(0),
+    m_size(0),
+    m_map(0)
+{
+}
+
+DpkgFileIndex::~DpkgFileIndex()
+{
+    if (m_map) {
+        munmap(m_map, m_size);
+    }
+}
+
+vector<string> DpkgFileIndex::findOwners(gchar **paths)
+{
+    vector<string> ret;
+
+    g_mutex_lock(&s_mutex);
+    const DpkgFileIndex *index = current();
+    if (index == 0) {
+        g_mutex_unlock(&s_mutex);
+        return ret;
+    }
+
+    const IndexPath *begin = index->paths();
+    const IndexPath *end = begin + index->header()->pathCount;
+    const IndexPackage *packages = index->packages();
+    const char *strings = index->strings();
+    for (guint i = 0; paths[i] != NULL; ++i) {
+        IndexPath key;
+        size_t size = strlen(paths[i]);
+        key.hash = hashPath(paths[i], size);
+
+        // Different paths might share the hash
+        std::pair<const IndexPath*, const IndexPath*> range;
+        range = std::equal_range(begin, end, key, pathLess);
+        for (const IndexPath *it = range.first; it != range.second; ++it) {
+            if (it->pathSize == size && memcmp(strings + it->path, paths[i], size) == 0) {
+                const IndexPackage &pkg = packages[it->package];
+                ret.push_back(string(strings + pkg.name, pkg.nameSize));
+            }
+        }
+    }
+    g_mutex_unlock(&s_mutex);
+
+    std::sort(ret.begin(), ret.end());
+    ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+
+    return ret;
+}
+
+bool DpkgFileIndex::packageFiles(const string &name, vector<string> &files)
+{
+    g_mutex_lock(&s_mutex);
+    const DpkgFileIndex *index = current();
+    const IndexPackage *pkg = index ? index->findPackage(name) : 0;
+    if (pkg == 0) {
+        g_mutex_unlock(&s_mutex);
+        return false;
+    }
+
+    const char *line = index->strings() + pkg->contents;
+    const char *end = line + pkg->contentsSize;
+    while (line < end) {
+        const char *newLine = static_cast<const char*>(memchr(line, '\n', end - line));
+        if (newLine == NULL) {
+            newLine = end;
+        }
+        if (newLine != line) {
+            files.push_back(string(line, newLine - line));
+        }
+        line = newLine + 1;
+    }
+    g_mutex_unlock(&s_mutex);
+
+    return true;
+}
+
+DpkgFileIndex* DpkgFileIndex::current()
+{
+    struct stat dirStat;
+    if (stat(DPKG_INFO_DIR, &dirStat) != 0) {
+        g_debug("Error opening %s", DPKG_INFO_DIR);
+        return 0;
+    }
+
+    if (s_current &&
+            s_current->header()->dirMtimeSec == dirStat.st_mtim.tv_sec &&
+            s_current->header()->dirMtimeNsec == dirStat.st_mtim.tv_nsec) {
+        return s_current;
+    }
+
+    const string fileName = _config->FindDir("Dir::Cache") + INDEX_FILE_NAME;
+    if (s_current == 0) {
+        // Maybe an older daemon already left an index for us
+        DpkgFileIndex *index = new DpkgFileIndex;
+        if (index->load(fileName)) {
+            s_current = index;
+            if (index->header()->dirMtimeSec == dirStat.st_mtim.tv_sec &&
+                    index->header()->dirMtimeNsec == dirStat.st_mtim.tv_nsec) {
+                return s_current;
+            }
+        } else {
+            delete index;
+        }
+    }
+
+    // dpkg changed something, read the .list files that changed
+    DpkgFileIndex *index = new DpkgFileIndex;
+    if (!index->build(fileName, dirStat, s_current)) {
+        delete index;
+        return s_current;
+    }
+
+    delete s_current;
+    s_current = index;
+
+    return s_current;
+}
+
+bool DpkgFileIndex::load(const string &fileName)
+{
+    int fd = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat buf;
+    if (fstat(fd, &buf) != 0 || buf.st_size < (off_t) sizeof(IndexHeader)) {
+        close(fd);
+        return false;
+    }
+
+    void *map = mmap(NULL, buf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    m_map = map;
+    m_size = buf.st_size;
+    m_data = static_cast<const char*>(map);
+
+    // Don't trust a file that was cut short or has an old layout
+    const IndexHeader *head = header();
+    if (head->magic != INDEX_MAGIC || head->pathCount > m_size) {
+        g_debug("Ignoring invalid file index %s", fileName.c_str());
+        return false;
+    }
+
+    const guint64 expected = sizeof(IndexHeader) +
+            head->packageCount * sizeof(IndexPackage) +
+            head->pathCount * sizeof(IndexPath) +
+            head->stringsSize;
+    if (expected != m_size) {
+        g_debug("Ignoring invalid file index %s", fileName.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool DpkgFileIndex::build(const string &fileName, const struct stat &dirStat, const DpkgFileIndex *old)
+{
+    DIR *dp = opendir(DPKG_INFO_DIR);
+    if (dp == NULL) {
+        g_debug("Error opening %s", DPKG_INFO_DIR);
+        return false;
+    }
+
+    vector<ListFile> pkgs;
+    struct dirent *dirp;
+    guint reused = 0;
+    while ((dirp = readdir(dp)) != NULL) {
+        string name(dirp->d_name);
+        if (!ends_with(name, ".list")) {
+            continue;
+        }
+
+        ListFile pkg;
+        const string listFile = DPKG_INFO_DIR + name;
+        if (stat(listFile.c_str(), &pkg.info) != 0) {
+            continue;
+        }
+        pkg.name = name.erase(name.size() - 5);
+
+        // Only read what changed since the last index
+        const IndexPackage *oldPkg = old ? old->findPackage(pkg.name) : 0;
+        if (oldPkg &&
+                oldPkg->mtimeSec == pkg.info.st_mtim.tv_sec &&
+                oldPkg->mtimeNsec == pkg.info.st_mtim.tv_nsec &&
+                oldPkg->contentsSize == (guint64) pkg.info.st_size) {
+            pkg.contents.assign(old->strings() + oldPkg->contents, oldPkg->contentsSize);
+            ++reused;
+        } else {
+            gchar *contents;
+            gsize length;
+            if (!g_file_get_contents(listFile.c_str(), &contents, &length, NULL)) {
+                continue;
+            }
+            pkg.contents.assign(contents, length);
+            g_free(contents);
+        }
+
+        pkgs.push_back(pkg);
+    }
+    closedir(dp);
+
+    std::sort(pkgs.begin(), pkgs.end());
+
+    // Lay the strings out and hash every path
+    vector<IndexPackage> packages(pkgs.size());
+    vector<IndexPath> paths;
+    guint64 stringsSize = 0;
+    for (guint i = 0; i < pkgs.size(); ++i) {
+        IndexPackage &pkg = packages[i];
+        memset(&pkg, 0, sizeof(pkg));
+        pkg.name = stringsSize;
+        pkg.nameSize = pkgs[i].name.size();
+        pkg.contents = pkg.name + pkg.nameSize;
+        pkg.contentsSize = pkgs[i].contents.size();
+        pkg.mtimeSec = pkgs[i].info.st_mtim.tv_sec;
+        pkg.mtimeNsec = pkgs[i].info.st_mtim.tv_nsec;
+        stringsSize = pkg.contents + pkg.contentsSize;
+
+        const string &contents = pkgs[i].contents;
+        string::size_type start = 0;
+        while (start < contents.size()) {
+            string::size_type newLine = contents.find('\n', start);
+            if (newLine == string::npos) {
+                newLine = contents.size();
+            }
+            if (newLine != start) {
+                IndexPath path;
+                path.hash = hashPath(contents.data() + start, newLine - start);
+                path.path = pkg.contents + start;
+                path.pathSize = newLine - start;
+                path.package = i;
+                paths.push_back(path);
+            }
+            start = newLine + 1;
+        }
+    }
+    std::stable_sort(paths.begin(), paths.end(), pathLess);
+
+    IndexHeader head;
+    memset(&head, 0, sizeof(head));
+    head.magic = INDEX_MAGIC;
+    head.packageCount = packages.size();
+    head.pathCount = paths.size();
+    head.stringsSize = stringsSize;
+    head.dirMtimeSec = dirStat.st_mtim.tv_sec;
+    head.dirMtimeNsec = dirStat.st_mtim.tv_nsec;
+
+    m_buffer.resize(sizeof(IndexHeader) +
+                    packages.size() * sizeof(IndexPackage) +
+                    paths.size() * sizeof(IndexPath) +
+                    stringsSize);
+    char *data = &m_buffer[0];
+    memcpy(data, &head, sizeof(head));
+    data += sizeof(head);
+    if (!packages.empty()) {
+        memcpy(data, &packages[0], packages.size() * sizeof(IndexPackage));
+        data += packages.size() * sizeof(IndexPackage);
+    }
+    if (!paths.empty()) {
+        memcpy(data, &paths[0], paths.size() * sizeof(IndexPath));
+        data += paths.size() * sizeof(IndexPath);
+    }
+    for (vector<ListFile>::const_iterator it = pkgs.begin(); it != pkgs.end(); ++it) {
+        memcpy(data, it->name.data(), it->name.size());
+        data += it->name.size();
+        memcpy(data, it->contents.data(), it->contents.size());
+        data += it->contents.size();
+    }
+    m_data = &m_buffer[0];
+    m_size = m_buffer.size();
+
+    g_debug("Indexed %lu files of %lu packages, %u reused",
+            (unsigned long) paths.size(), (unsigned long) packages.size(), reused);
+
+    // Save it for the next time the daemon starts, failing is harmless
+    const string tmpFileName = fileName + ".new";
+    if (!g_file_set_contents(tmpFileName.c_str(), m_data, m_size, NULL) ||
+            rename(tmpFileName.c_str(), fileName.c_str()) != 0) {
+        g_debug("Failed to save the file index to %s", fileName.c_str());
+        unlink(tmpFileName.c_str());
+    }
+
+    return true;
+}
+
+const IndexHeader* DpkgFileIndex::header() const
+{
+    return reinterpret_cast<const IndexHeader*>(m_data);
+}
+
+const IndexPackage* DpkgFileIndex::packages() const
+{
+    return reinterpret_cast<const IndexPackage*>(m_data + sizeof(IndexHeader));
+}
+
+const IndexPath* DpkgFileIndex::paths() const
+{
+    return reinterpret_cast<const IndexPath*>(packages() + header()->packageCount);
+}
+
+const char* DpkgFileIndex::strings() const
+{
+    return reinterpret_cast<const char*>(paths() + header()->pathCount);
+}
+
+const IndexPackage* DpkgFileIndex::findPackage(const string &name) const
+{
+    const IndexPackage *pkgs = packages();
+    const char *str = strings();
+
+    // The packages are sorted by name
+    guint32 low = 0;
+    guint32 high = header()->packageCount;
+    while (low < high) {
+        guint32 mid = low + (high - low) / 2;
+        const string pkgName(str + pkgs[mid].name, pkgs[mid].nameSize);
+        int cmp = pkgName.compare(name);
+        if (cmp == 0) {
+            return &pkgs[mid];
+        } else if (cmp < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,78 @@
+/* DpkgFileIndex.h
+ *
+ * Copyright (c) 2014 PackageKit contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#ifndef DPKGFILEINDEX_H
+#define DPKGFILEINDEX_H
+
+#include <glib.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+
+struct IndexHeader;
+struct IndexPackage;
+struct IndexPath;
+
+/**
+ * Maps the paths listed in dpkg's info/<package>.list files to the packages
+ * owning them. The index is kept on disk next to apt's caches and when
+ * dpkg changes its database only the .list files that changed are read
+ */
+class DpkgFileIndex
+{
+public:
+    /**
+      * Returns the names of the packages owning any of the given paths,
+      * these are the .list file names so they may include the arch
+      */
+    static std::vector<std::string> findOwners(gchar **paths);
+
+    /**
+      * Gets the files installed by the package with the given
+      * .list file name, returning false if it is not installed
+      */
+    static bool packageFiles(const std::string &name, std::vector<std::string> &files);
+
+private:
+    DpkgFileIndex();
+    ~DpkgFileIndex();
+
+    /**
+      * Returns the index matching the dpkg database, updating
+      * it if needed, the caller must hold the index mutex
+      */
+    static DpkgFileIndex* current();
+
+    bool load(const std::string &fileName);
+    bool build(const std::string &fileName, const struct stat &dirStat, const DpkgFileIndex *old);
+
+    const IndexHeader* header() const;
+    const IndexPackage* packages() const;
+    const IndexPath* paths() const;
+    const char* strings() const;
+    const IndexPackage* findPackage(const std::string &name) const;
+
+    const char *m_data;
+    size_t m_size;
+    void *m_map;
+    std::vector<char> m_buffer;
+};
+
+#endif // DPKGFILEINDEX_H
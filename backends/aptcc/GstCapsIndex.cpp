@@ -0,0 +1,95 @@
+/* GstCapsIndex.cpp
+ *
+ * Copyright (c) 2014 PackageKit contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#include "GstCapsIndex.h"
+
+#include "apt-utils.h"
+
+#include <apt-pkg/pkgrecords.h>
+
+#include <algorithm>
+
+static const char *s_fields[] = {
+    "Gstreamer-Encoders",
+    "Gstreamer-Decoders",
+    "Gstreamer-Uri-Sources",
+    "Gstreamer-Uri-Sinks",
+    "Gstreamer-Elements",
+    NULL
+};
+
+// Returns the value of a single line field of the record
+static bool findField(const char *start, const char *stop, const char *name, std::string &value)
+{
+    const std::string key = std::string("\n") + name + ":";
+    const char *found = std::search(start, stop, key.begin(), key.end());
+    if (found == stop) {
+        return false;
+    }
+
+    found += key.size();
+    while (found != stop && *found == ' ') {
+        ++found;
+    }
+    value.assign(found, std::find(found, stop, '\n'));
+    return true;
+}
+
+GstCapsIndex::GstCapsIndex(pkgCacheFile &cache)
+{
+    pkgCache *pkgcache = cache.GetPkgCache();
+    pkgRecords records(*pkgcache);
+
+    for (pkgCache::PkgIterator pkg = pkgcache->PkgBegin(); !pkg.end(); ++pkg) {
+        // Ignore virtual packages
+        const pkgCache::VerIterator &ver = findVer(cache, pkg);
+        if (ver.end() || ver.FileList().end()) {
+            continue;
+        }
+
+        const char *start, *stop;
+        records.Lookup(ver.FileList()).GetRec(start, stop);
+
+        // Only a few packages are GStreamer plugins
+        std::string gstVersion;
+        if (!findField(start, stop, "Gstreamer-Version", gstVersion)) {
+            continue;
+        }
+
+        for (guint i = 0; s_fields[i] != NULL; ++i) {
+            Entry entry;
+            if (!findField(start, stop, s_fields[i], entry.caps) || entry.caps.empty()) {
+                continue;
+            }
+
+            entry.ver = ver.Index();
+            m_entries[std::make_pair(gstVersion, std::string(s_fields[i]))].push_back(entry);
+        }
+    }
+}
+
+const std::vector<GstCapsIndex::Entry>* GstCapsIndex::find(const std::string &version, const std::string &field) const
+{
+    std::map<std::pair<std::string, std::string>, std::vector<Entry> >::const_iterator it;
+    it = m_entries.find(std::make_pair(version, field));
+    if (it == m_entries.end()) {
+        return NULL;
+    }
+    return &it->second;
+}
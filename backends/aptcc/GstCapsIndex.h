@@ -0,0 +1,59 @@
+/* GstCapsIndex.h
+ *
+ * Copyright (c) 2014 PackageKit contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#ifndef GSTCAPSINDEX_H
+#define GSTCAPSINDEX_H
+
+#include <apt-pkg/cachefile.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * The Gstreamer-* fields of the package records, read once per
+ * cache so codec lookups don't need to parse every record again
+ */
+class GstCapsIndex
+{
+public:
+    struct Entry {
+        // offset of the version from pkgCache::VerP
+        map_ptrloc ver;
+        // the field value, a list of caps
+        std::string caps;
+    };
+
+    /**
+      * Reads the records, the cache must not change afterwards
+      */
+    GstCapsIndex(pkgCacheFile &cache);
+
+    /**
+      * Returns the values of the given field, like "Gstreamer-Decoders",
+      * of the packages built for the given GStreamer version, or NULL
+      */
+    const std::vector<Entry>* find(const std::string &version, const std::string &field) const;
+
+private:
+    // keyed by the version and the field name
+    std::map<std::pair<std::string, std::string>, std::vector<Entry> > m_entries;
+};
+
+#endif // GSTCAPSINDEX_H
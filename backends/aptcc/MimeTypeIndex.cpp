@@ -0,0 +1,174 @@
+/* MimeTypeIndex.cpp
+ *
+ * Copyright (c) 2014 PackageKit contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#include "MimeTypeIndex.h"
+
+#include "apt-utils.h"
+
+#include <apt-pkg/configuration.h>
+
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <cstdio>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+#define DESKTOP_DIR      "/usr/share/app-install/desktop/"
+#define INDEX_FILE_NAME  "pkgmimetypes.cache"
+
+using std::string;
+using std::vector;
+
+typedef std::multimap<string, string> MimeTypeMap;
+
+// The index in memory and the directory mtime it was built for
+static MimeTypeMap s_index;
+static string s_stamp;
+static GMutex s_mutex;
+
+static string dirStamp()
+{
+    struct stat buf;
+    if (stat(DESKTOP_DIR, &buf) != 0) {
+        return string();
+    }
+
+    char str[64];
+    snprintf(str, sizeof(str), "%ld.%09ld",
+             (long) buf.st_mtim.tv_sec,
+             (long) buf.st_mtim.tv_nsec);
+    return str;
+}
+
+// The file is the directory stamp followed by "type\tpackage" lines
+static bool loadIndex(const string &fileName, const string &stamp)
+{
+    std::ifstream in(fileName.c_str());
+    string line;
+    if (!getline(in, line) || line != stamp) {
+        return false;
+    }
+
+    s_index.clear();
+    while (getline(in, line)) {
+        string::size_type tab = line.find('\t');
+        if (tab != string::npos) {
+            s_index.insert(std::make_pair(line.substr(0, tab), line.substr(tab + 1)));
+        }
+    }
+    return true;
+}
+
+static void saveIndex(const string &fileName, const string &stamp)
+{
+    std::ostringstream out;
+    out << stamp << '\n';
+    for (MimeTypeMap::const_iterator it = s_index.begin(); it != s_index.end(); ++it) {
+        out << it->first << '\t' << it->second << '\n';
+    }
+
+    // Failing is harmless, it will be built again next time
+    const string data = out.str();
+    const string tmpFileName = fileName + ".new";
+    if (!g_file_set_contents(tmpFileName.c_str(), data.c_str(), data.size(), NULL) ||
+            rename(tmpFileName.c_str(), fileName.c_str()) != 0) {
+        g_debug("Failed to save the MIME type index to %s", fileName.c_str());
+        unlink(tmpFileName.c_str());
+    }
+}
+
+static void buildIndex()
+{
+    s_index.clear();
+
+    DIR *dp = opendir(DESKTOP_DIR);
+    if (dp == NULL) {
+        g_debug("Error opening %s", DESKTOP_DIR);
+        return;
+    }
+
+    struct dirent *dirp;
+    while ((dirp = readdir(dp)) != NULL) {
+        if (!ends_with(dirp->d_name, ".desktop")) {
+            continue;
+        }
+
+        const string fileName = DESKTOP_DIR + string(dirp->d_name);
+        std::ifstream in(fileName.c_str());
+        string line;
+        string mimeTypes;
+        string package;
+        while (getline(in, line)) {
+            if (starts_with(line, "MimeType=")) {
+                mimeTypes = line.substr(9);
+            } else if (starts_with(line, "X-AppInstall-Package=")) {
+                package = line.substr(21);
+            }
+        }
+
+        if (package.empty() || mimeTypes.empty()) {
+            continue;
+        }
+
+        gchar **types = g_strsplit(mimeTypes.c_str(), ";", -1);
+        for (guint i = 0; types[i] != NULL; ++i) {
+            if (types[i][0] != '\0') {
+                s_index.insert(std::make_pair(string(types[i]), package));
+            }
+        }
+        g_strfreev(types);
+    }
+    closedir(dp);
+}
+
+vector<string> MimeTypeIndex::findPackages(gchar **mimeTypes)
+{
+    vector<string> ret;
+
+    g_mutex_lock(&s_mutex);
+    const string stamp = dirStamp();
+    if (stamp != s_stamp) {
+        const string fileName = _config->FindDir("Dir::Cache") + INDEX_FILE_NAME;
+        if (stamp.empty()) {
+            // app-install-data is not installed
+            s_index.clear();
+        } else if (!loadIndex(fileName, stamp)) {
+            buildIndex();
+            saveIndex(fileName, stamp);
+        }
+        s_stamp = stamp;
+    }
+
+    for (guint i = 0; mimeTypes[i] != NULL; ++i) {
+        std::pair<MimeTypeMap::const_iterator, MimeTypeMap::const_iterator> range;
+        range = s_index.equal_range(mimeTypes[i]);
+        for (MimeTypeMap::const_iterator it = range.first; it != range.second; ++it) {
+            ret.push_back(it->second);
+        }
+    }
+    g_mutex_unlock(&s_mutex);
+
+    std::sort(ret.begin(), ret.end());
+    ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+
+    return ret;
+}
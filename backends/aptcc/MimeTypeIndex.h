@@ -0,0 +1,42 @@
+/* MimeTypeIndex.h
+ *
+ * Copyright (c) 2014 PackageKit contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#ifndef MIMETYPEINDEX_H
+#define MIMETYPEINDEX_H
+
+#include <glib.h>
+
+#include <string>
+#include <vector>
+
+/**
+ * Maps MIME types to the packages of the applications handling them,
+ * using the desktop files of app-install-data. The index is kept on
+ * disk and only rebuilt when the desktop files directory changes
+ */
+class MimeTypeIndex
+{
+public:
+    /**
+      * Returns the names of the packages handling any of the MIME types
+      */
+    static std::vector<std::string> findPackages(gchar **mimeTypes);
+};
+
+#endif // MIMETYPEINDEX_H
@@ -0,0 +1,95 @@
+/* PkgScanner.cpp
+ *
+ * Copyright (c) 2014 PackageKit contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#include "PkgScanner.h"
+
+#include <glib.h>
+
+#include <vector>
+
+// Not worth a thread for fewer packages than this
+#define MIN_SHARD_SIZE 4096
+
+struct Shard
+{
+    PkgScanner *scanner;
+    pkgCache *cache;
+    std::vector<map_ptrloc>::const_iterator begin;
+    std::vector<map_ptrloc>::const_iterator end;
+    const gint *cancelled;
+    PkgList output;
+};
+
+static gpointer scanShard(gpointer data)
+{
+    Shard *shard = static_cast<Shard*>(data);
+    for (std::vector<map_ptrloc>::const_iterator it = shard->begin; it != shard->end; ++it) {
+        if (g_atomic_int_get(shard->cancelled)) {
+            break;
+        }
+
+        const pkgCache::PkgIterator pkg(*shard->cache, shard->cache->PkgP + *it);
+        shard->scanner->scan(pkg, shard->output);
+    }
+    return NULL;
+}
+
+PkgScanner::~PkgScanner()
+{
+}
+
+void PkgScanner::run(pkgCache *cache, PkgList &output, const gint &cancelled) const
+{
+    // Packages are chained through the hash table, so take
+    // note of where each one is to be able to split them
+    std::vector<map_ptrloc> packages;
+    packages.reserve(cache->HeaderP->PackageCount);
+    for (pkgCache::PkgIterator pkg = cache->PkgBegin(); !pkg.end(); ++pkg) {
+        packages.push_back(pkg.Index());
+    }
+
+    guint shardCount = MIN(g_get_num_processors(), packages.size() / MIN_SHARD_SIZE);
+    shardCount = MAX(shardCount, 1);
+
+    std::vector<Shard> shards(shardCount);
+    std::vector<GThread*> threads(shardCount, (GThread*) NULL);
+    const size_t shardSize = packages.size() / shardCount;
+    for (guint i = 0; i < shardCount; ++i) {
+        Shard &shard = shards[i];
+        shard.scanner = clone();
+        shard.cache = cache;
+        shard.begin = packages.begin() + i * shardSize;
+        shard.end = i + 1 == shardCount ? packages.end() : shard.begin + shardSize;
+        shard.cancelled = &cancelled;
+
+        // The first shard is scanned by the calling thread
+        if (i > 0) {
+            threads[i] = g_thread_new("aptcc-scan", scanShard, &shard);
+        }
+    }
+    scanShard(&shards[0]);
+
+    for (guint i = 0; i < shardCount; ++i) {
+        if (threads[i]) {
+            g_thread_join(threads[i]);
+        }
+        output.insert(output.end(), shards[i].output.begin(), shards[i].output.end());
+        delete shards[i].scanner;
+    }
+}
@@ -0,0 +1,58 @@
+/* PkgScanner.h
+ *
+ * Copyright (c) 2014 PackageKit contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#ifndef PKG_SCANNER_H
+#define PKG_SCANNER_H
+
+#include <glib.h>
+#include <apt-pkg/pkgcache.h>
+
+#include "PkgList.h"
+
+/**
+ * Walks all packages of the cache on several threads, the packages
+ * are split in contiguous shards and each shard is scanned by its
+ * own copy of the scanner, so scan() must only read from the cache
+ */
+class PkgScanner
+{
+public:
+    virtual ~PkgScanner();
+
+    /**
+      * Returns a copy for one worker thread, anything that is not
+      * thread safe (like pkgRecords) must not be shared with it
+      */
+    virtual PkgScanner* clone() const = 0;
+
+    /**
+      * Called for every package of a shard in cache order,
+      * the matching versions must be appended to output
+      */
+    virtual void scan(const pkgCache::PkgIterator &pkg, PkgList &output) = 0;
+
+    /**
+      * Scans the whole cache, the output of the shards is appended
+      * in cache order so it is the same as a single threaded walk,
+      * cancelled is read atomically as it is set from another thread
+      */
+    void run(pkgCache *cache, PkgList &output, const gint &cancelled) const;
+};
+
+#endif // PKG_SCANNER_H
@@ -0,0 +1,102 @@
+/* ReverseDepends.cpp
+ *
+ * Copyright (c) 2014 PackageKit contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#include "ReverseDepends.h"
+
+#include "apt-utils.h"
+
+#include <algorithm>
+#include <utility>
+
+typedef std::pair<unsigned int, unsigned int> Edge;
+
+static void addParents(std::vector<Edge> &edges,
+                       const std::vector<unsigned int> &verOf,
+                       unsigned int id,
+                       pkgCache::DepIterator dep)
+{
+    for (; !dep.end(); ++dep) {
+        if (dep->Type != pkgCache::Dep::Depends) {
+            continue;
+        }
+
+        // Only the version we would show for the parent counts
+        const pkgCache::PkgIterator &parentPkg = dep.ParentPkg();
+        if (dep.ParentVer().Index() != verOf[parentPkg->ID]) {
+            continue;
+        }
+
+        edges.push_back(Edge(id, parentPkg.Index()));
+    }
+}
+
+ReverseDepends::ReverseDepends(pkgCacheFile &cache)
+{
+    pkgCache *pkgcache = cache.GetPkgCache();
+    const unsigned int packageCount = pkgcache->HeaderP->PackageCount;
+
+    // Pick the version of every package once, IDs are only good for
+    // indexing so the map offset of the version is stored, 0 is none
+    std::vector<unsigned int> verOf(packageCount, 0);
+    for (pkgCache::PkgIterator pkg = pkgcache->PkgBegin(); !pkg.end(); ++pkg) {
+        const pkgCache::VerIterator &ver = findVer(cache, pkg);
+        if (!ver.end()) {
+            verOf[pkg->ID] = ver.Index();
+        }
+    }
+
+    std::vector<Edge> edges;
+    for (pkgCache::PkgIterator pkg = pkgcache->PkgBegin(); !pkg.end(); ++pkg) {
+        // Ignore packages that exist only due to dependencies
+        if (verOf[pkg->ID] == 0) {
+            continue;
+        }
+        pkgCache::VerIterator ver(*pkgcache, pkgcache->VerP + verOf[pkg->ID]);
+
+        addParents(edges, verOf, pkg->ID, pkg.RevDependsList());
+
+        // Packages depending on something we provide depend on us too
+        for (pkgCache::PrvIterator prv = ver.ProvidesList(); !prv.end(); ++prv) {
+            addParents(edges, verOf, pkg->ID, prv.ParentPkg().RevDependsList());
+        }
+    }
+
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+    m_offsets.assign(packageCount + 1, 0);
+    m_parents.reserve(edges.size());
+    for (std::vector<Edge>::const_iterator it = edges.begin(); it != edges.end(); ++it) {
+        ++m_offsets[it->first + 1];
+        m_parents.push_back(it->second);
+    }
+    for (unsigned int i = 0; i < packageCount; ++i) {
+        m_offsets[i + 1] += m_offsets[i];
+    }
+}
+
+ReverseDepends::const_iterator ReverseDepends::begin(const pkgCache::PkgIterator &pkg) const
+{
+    return m_parents.begin() + m_offsets[pkg->ID];
+}
+
+ReverseDepends::const_iterator ReverseDepends::end(const pkgCache::PkgIterator &pkg) const
+{
+    return m_parents.begin() + m_offsets[pkg->ID + 1];
+}
@@ -0,0 +1,55 @@
+/* ReverseDepends.h
+ *
+ * Copyright (c) 2014 PackageKit contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#ifndef REVERSEDEPENDS_H
+#define REVERSEDEPENDS_H
+
+#include <apt-pkg/cachefile.h>
+
+#include <vector>
+
+/**
+ * Maps every package to the packages that depend on it, either directly
+ * or through something it provides, only the version AptCacheFile::findVer()
+ * would pick for the depending package is taken into account
+ */
+class ReverseDepends
+{
+public:
+    typedef std::vector<unsigned int>::const_iterator const_iterator;
+
+    /**
+      * Builds the index, the cache must not change afterwards
+      */
+    ReverseDepends(pkgCacheFile &cache);
+
+    /**
+      * The packages depending on pkg, as offsets from pkgCache::PkgP
+      */
+    const_iterator begin(const pkgCache::PkgIterator &pkg) const;
+    const_iterator end(const pkgCache::PkgIterator &pkg) const;
+
+private:
+    // m_parents[m_offsets[id]] to m_parents[m_offsets[id + 1]]
+    // holds the packages depending on the package with that ID
+    std::vector<unsigned int> m_offsets;
+    std::vector<unsigned int> m_parents;
+};
+
+#endif // REVERSEDEPENDS_H
@@ -34,12 +34,21 @@
 #include <sys/statfs.h>
 #include <sys/wait.h>
 #include <sys/fcntl.h>
+#include <poll.h>
 #include <pty.h>
 
 #include <fstream>
+#include <deque>
 #include <dirent.h>
 
 #include "AptCacheFile.h"
+#include "AptSharedCache.h"
+#include "DescriptionCorpus.h"
+#include "DpkgFileIndex.h"
+#include "GstCapsIndex.h"
+#include "MimeTypeIndex.h"
+#include "PkgScanner.h"
+#include "ReverseDepends.h"
 #include "apt-utils.h"
 #include "matcher.h"
 #include "gstMatcher.h"
@@ -50,48 +59,43 @@
 
 #define RAMFS_MAGIC     0x858458f6
 
+// The proxies from apt.conf, they win over the ones of the jobs
+static string s_confHttpProxy;
+static string s_confFtpProxy;
+
 AptIntf::AptIntf(PkBackendJob *job) :
     m_job(job),
-    m_cancel(false),
+    m_cancel(FALSE),
+    m_writerLocked(false),
+    m_acquireLocked(false),
     m_terminalTimeout(120),
     m_lastSubProgress(0),
+    m_child_pid(0),
     m_cache(0)
 {
-    m_cancel = false;
-
     // Make sure initial m_time is 0
     m_restartStat.st_mtime = 0;
 }
 
-bool AptIntf::init()
+void AptIntf::initProxies()
 {
-    gchar *locale;
-    gchar *http_proxy;
-    gchar *ftp_proxy;
+    // Called once before any job runs, creating the keys here means
+    // lockAcquire() only changes their values and never the layout
+    // of the _config tree the other jobs are reading
+    s_confHttpProxy = _config->Find("Acquire::http::Proxy");
+    s_confFtpProxy = _config->Find("Acquire::ftp::Proxy");
+    _config->Set("Acquire::http::Proxy", s_confHttpProxy);
+    _config->Set("Acquire::ftp::Proxy", s_confFtpProxy);
+}
 
+bool AptIntf::init()
+{
     m_isMultiArch = APT::Configuration::getArchitectures(false).size() > 1;
 
-    // set locale
-    if (locale = pk_backend_job_get_locale(m_job)) {
-        setlocale(LC_ALL, locale);
-        // TODO why this cuts characthers on ui?
-        // 		string _locale(locale);
-        // 		size_t found;
-        // 		found = _locale.find('.');
-        // 		_locale.erase(found);
-        // 		_config->Set("APT::Acquire::Translation", _locale);
-    }
-    g_free(locale);
-
-    // set http proxy
-    http_proxy = pk_backend_job_get_proxy_http(m_job);
-    setenv("http_proxy", http_proxy, 1);
-    g_free(http_proxy);
-
-    // set ftp proxy
-    ftp_proxy = pk_backend_job_get_proxy_ftp(m_job);
-    setenv("ftp_proxy", ftp_proxy, 1);
-    g_free(ftp_proxy);
+    // The locale and the proxies are not set on the process here as
+    // the jobs run in parallel: the locale of the job is used to pick
+    // the descriptions in AptCacheFile and is set on the dpkg child in
+    // installPackages(), the proxies are set by lockAcquire()
 
     // Prepare for the restart thing
     if (g_file_test(REBOOT_REQUIRED, G_FILE_TEST_EXISTS)) {
@@ -126,9 +130,31 @@ bool AptIntf::init()
         withLock = !simulate;
     }
 
+    // Read-only jobs run in parallel, the ones that change
+    // the system wait for each other
+    switch (role) {
+    case PK_ROLE_ENUM_REFRESH_CACHE:
+    case PK_ROLE_ENUM_DOWNLOAD_PACKAGES:
+    case PK_ROLE_ENUM_REPAIR_SYSTEM:
+        if (!lockWriter()) {
+            return false;
+        }
+        break;
+    default:
+        if (withLock && !lockWriter()) {
+            return false;
+        }
+    }
+
     // Create the AptCacheFile class to search for packages
     m_cache = new AptCacheFile(m_job);
 
+    // Queries that never mark packages can use the backend wide
+    // cache instead of building the policy and depcache again
+    if (canUseSharedCache(role) && m_cache->OpenShared()) {
+        return true;
+    }
+
     int timeout = 10;
     // TODO test this
     while (m_cache->Open(withLock) == false) {
@@ -150,6 +176,47 @@ bool AptIntf::init()
     return m_cache->CheckDeps(AllowBroken);
 }
 
+bool AptIntf::canUseSharedCache(PkRoleEnum role)
+{
+    switch (role) {
+    case PK_ROLE_ENUM_DEPENDS_ON:
+    case PK_ROLE_ENUM_GET_DETAILS:
+    case PK_ROLE_ENUM_GET_FILES:
+    case PK_ROLE_ENUM_GET_PACKAGES:
+    case PK_ROLE_ENUM_GET_UPDATE_DETAIL:
+    case PK_ROLE_ENUM_REQUIRED_BY:
+    case PK_ROLE_ENUM_RESOLVE:
+    case PK_ROLE_ENUM_SEARCH_DETAILS:
+    case PK_ROLE_ENUM_SEARCH_FILE:
+    case PK_ROLE_ENUM_SEARCH_GROUP:
+    case PK_ROLE_ENUM_SEARCH_NAME:
+    case PK_ROLE_ENUM_WHAT_PROVIDES:
+        break;
+    default:
+        return false;
+    }
+
+    // The downloaded filter marks packages for installation
+    // to find out their archives, so it needs a private cache
+    GVariant *params = pk_backend_job_get_parameters(m_job);
+    if (params != NULL &&
+            g_variant_is_of_type(params, G_VARIANT_TYPE_TUPLE) &&
+            g_variant_n_children(params) > 0) {
+        GVariant *first = g_variant_get_child_value(params, 0);
+        bool downloaded = false;
+        if (g_variant_is_of_type(first, G_VARIANT_TYPE_UINT64)) {
+            PkBitfield filters = g_variant_get_uint64(first);
+            downloaded = pk_bitfield_contain(filters, PK_FILTER_ENUM_DOWNLOADED);
+        }
+        g_variant_unref(first);
+        if (downloaded) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 AptIntf::~AptIntf()
 {
     // Check the restart thing
@@ -172,12 +239,54 @@ AptIntf::~AptIntf()
     }
 
     delete m_cache;
+
+    if (m_acquireLocked) {
+        AptSharedCache::unlockAcquire();
+    }
+
+    if (m_writerLocked) {
+        AptSharedCache::unlockWriter();
+    }
+}
+
+bool AptIntf::lockWriter()
+{
+    if (!m_writerLocked) {
+        m_writerLocked = AptSharedCache::lockWriter(m_job, m_cancel);
+
+        // Jobs changing the system may download, they run one
+        // at a time so this only waits for changelog downloads
+        if (m_writerLocked) {
+            lockAcquire();
+        }
+    }
+    return m_writerLocked;
+}
+
+void AptIntf::lockAcquire()
+{
+    if (m_acquireLocked) {
+        return;
+    }
+    AptSharedCache::lockAcquire();
+    m_acquireLocked = true;
+
+    // The methods get _config when the fetcher starts them
+    gchar *http_proxy = pk_backend_job_get_proxy_http(m_job);
+    gchar *ftp_proxy = pk_backend_job_get_proxy_ftp(m_job);
+    if (s_confHttpProxy.empty()) {
+        _config->Set("Acquire::http::Proxy", http_proxy ? http_proxy : "");
+    }
+    if (s_confFtpProxy.empty()) {
+        _config->Set("Acquire::ftp::Proxy", ftp_proxy ? ftp_proxy : "");
+    }
+    g_free(http_proxy);
+    g_free(ftp_proxy);
 }
 
 void AptIntf::cancel()
 {
-    if (!m_cancel) {
-        m_cancel = true;
+    if (g_atomic_int_compare_and_exchange(&m_cancel, FALSE, TRUE)) {
         pk_backend_job_set_status(m_job, PK_STATUS_ENUM_CANCEL);
     }
 
@@ -188,7 +297,7 @@ void AptIntf::cancel()
 
 bool AptIntf::cancelled() const
 {
-    return m_cancel;
+    return g_atomic_int_get(&m_cancel);
 }
 
 void AptIntf::emitFinished()
@@ -348,7 +457,7 @@ PkgList AptIntf::filterPackages(const PkgList &packages, PkBitfield filters)
             {
                 pkgDepCache::ActionGroup group(*m_cache);
                 for (PkgList::const_iterator it = ret.begin(); it != ret.end(); ++it) {
-                    if (m_cancel) {
+                    if (cancelled()) {
                         break;
                     }
 
@@ -438,7 +547,7 @@ void AptIntf::emitPackages(PkgList &output, PkBitfield filters, PkInfoEnum state
 
     output = filterPackages(output, filters);
     for (PkgList::const_iterator it = output.begin(); it != output.end(); ++it) {
-        if (m_cancel) {
+        if (cancelled()) {
             break;
         }
 
@@ -473,7 +582,7 @@ void AptIntf::emitUpdates(PkgList &output, PkBitfield filters)
 
     output = filterPackages(output, filters);
     for (PkgList::const_iterator i = output.begin(); i != output.end(); ++i) {
-        if (m_cancel) {
+        if (cancelled()) {
             break;
         }
 
@@ -509,37 +618,30 @@ void AptIntf::providesCodec(PkgList &output, gchar **values)
 {
     GstMatcher *matcher = new GstMatcher(values);
     if (!matcher->hasMatches()) {
+        delete matcher;
         return;
     }
 
-    for (pkgCache::PkgIterator pkg = m_cache->GetPkgCache()->PkgBegin(); !pkg.end(); ++pkg) {
-        if (m_cancel) {
-            delete matcher;
-            break;
-        }
-
-        // Ignore packages that exist only due to dependencies.
-        if (pkg.VersionList().end() && pkg.ProvidesList().end()) {
+    // Only the packages having the right field need to be checked
+    const GstCapsIndex &index = m_cache->gstCaps();
+    pkgCache *cache = m_cache->GetPkgCache();
+    const vector<Match> &matches = matcher->matchList();
+    for (vector<Match>::const_iterator it = matches.begin(); it != matches.end(); ++it) {
+        const vector<GstCapsIndex::Entry> *entries = index.find(it->version, it->type);
+        if (entries == NULL) {
             continue;
         }
 
-        // TODO search in updates packages
-        // Ignore virtual packages
-        pkgCache::VerIterator ver = m_cache->findVer(pkg);
-        if (ver.end() == true) {
-            ver = m_cache->findCandidateVer(pkg);
-            if (ver.end() == true) {
-                continue;
+        for (vector<GstCapsIndex::Entry>::const_iterator entry = entries->begin();
+             entry != entries->end();
+             ++entry) {
+            if (cancelled()) {
+                break;
             }
-        }
 
-        pkgCache::VerFileIterator vf = ver.FileList();
-        pkgRecords::Parser &rec = m_cache->GetPkgRecords()->Lookup(vf);
-        const char *start, *stop;
-        rec.GetRec(start, stop);
-        string record(start, stop - start);
-        if (matcher->matches(record)) {
-            output.push_back(ver);
+            if (matcher->matches(*it, entry->caps)) {
+                output.push_back(pkgCache::VerIterator(*cache, cache->VerP + entry->ver));
+            }
         }
     }
 
@@ -571,6 +673,7 @@ void AptIntf::providesLibrary(PkgList &output, gchar **values)
     }
 
     gchar *value;
+    vector<string> libPkgNames;
     for (uint i = 0; i < g_strv_length(values); i++) {
         value = values[i];
         regmatch_t matches[2];
@@ -590,30 +693,46 @@ void AptIntf::providesLibrary(PkgList &output, gchar **values)
 
             g_debug ("pkg-name: %s", libPkgName.c_str ());
 
-            for (pkgCache::PkgIterator pkg = m_cache->GetPkgCache()->PkgBegin(); !pkg.end(); ++pkg) {
-                // Ignore packages that exist only due to dependencies.
-                if (pkg.VersionList().end() && pkg.ProvidesList().end()) {
-                    continue;
-                }
+            // Make everything lower-case
+            std::transform(libPkgName.begin(), libPkgName.end(), libPkgName.begin(), ::tolower);
+            libPkgNames.push_back(libPkgName);
+        } else {
+            g_debug("libmatcher: Did not match: %s", value);
+        }
+    }
+    regfree(&libreg);
 
-                // TODO: Ignore virtual packages
-                pkgCache::VerIterator ver = m_cache->findVer(pkg);
-                if (ver.end()) {
-                    ver = m_cache->findCandidateVer(pkg);
-                    if (ver.end()) {
-                        continue;
-                    }
-                }
+    // The package names are hashed in the cache, no need to walk it
+    pkgCache *cache = m_cache->GetPkgCache();
+    for (vector<string>::const_iterator it = libPkgNames.begin(); it != libPkgNames.end(); ++it) {
+        if (cancelled()) {
+            break;
+        }
 
-                // Make everything lower-case
-                std::transform(libPkgName.begin(), libPkgName.end(), libPkgName.begin(), ::tolower);
+        // One package per architecture
+        pkgCache::GrpIterator grp = cache->FindGrp(*it);
+        if (grp.end()) {
+            continue;
+        }
 
-                if (g_strcmp0 (pkg.Name (), libPkgName.c_str ()) == 0) {
-                    output.push_back(ver);
+        for (pkgCache::PkgIterator pkg = grp.PackageList(); !pkg.end(); pkg = grp.NextPkg(pkg)) {
+            pkgCache::VerIterator ver = m_cache->findVer(pkg);
+            if (ver.end()) {
+                ver = m_cache->findCandidateVer(pkg);
+            }
+
+            if (!ver.end()) {
+                output.push_back(ver);
+                continue;
+            }
+
+            // A virtual package, add what provides it
+            for (pkgCache::PrvIterator prv = pkg.ProvidesList(); !prv.end(); ++prv) {
+                const pkgCache::VerIterator &ownerVer = m_cache->findVer(prv.OwnerPkg());
+                if (!ownerVer.end()) {
+                    output.push_back(ownerVer);
                 }
             }
-        } else {
-            g_debug("libmatcher: Did not match: %s", value);
         }
     }
 }
@@ -755,7 +874,7 @@ void AptIntf::emitDetails(PkgList &pkgs)
     pkgs.removeDuplicates();
 
     for (PkgList::const_iterator i = pkgs.begin(); i != pkgs.end(); ++i) {
-        if (m_cancel) {
+        if (cancelled()) {
             break;
         }
 
@@ -804,6 +923,9 @@ void AptIntf::emitUpdateDetail(const pkgCache::VerIterator &candver)
 
     PkBackend *backend = PK_BACKEND(pk_backend_job_get_backend(m_job));
     if (pk_backend_is_online(backend)) {
+        // Use the proxies of this job
+        lockAcquire();
+
         // Create the download object
         AcqPackageKitStatus Stat(this, m_job);
 
@@ -961,7 +1083,7 @@ void AptIntf::emitUpdateDetail(const pkgCache::VerIterator &candver)
 void AptIntf::emitUpdateDetails(const PkgList &pkgs)
 {
     for (PkgList::const_iterator it = pkgs.begin(); it != pkgs.end(); ++it) {
-        if (m_cancel) {
+        if (cancelled()) {
             break;
         }
 
@@ -975,7 +1097,7 @@ void AptIntf::getDepends(PkgList &output,
 {
     pkgCache::DepIterator dep = ver.DependsList();
     while (!dep.end()) {
-        if (m_cancel) {
+        if (cancelled()) {
             break;
         }
 
@@ -999,55 +1121,75 @@ void AptIntf::getDepends(PkgList &output,
 }
 
 void AptIntf::getRequires(PkgList &output,
-                          const pkgCache::VerIterator &ver,
+                          const PkgList &pkgs,
                           bool recursive)
 {
-    for (pkgCache::PkgIterator parentPkg = m_cache->GetPkgCache()->PkgBegin(); !parentPkg.end(); ++parentPkg) {
-        if (m_cancel) {
-            break;
+    const ReverseDepends &revDepends = m_cache->reverseDepends();
+    pkgCache *cache = m_cache->GetPkgCache();
+
+    // Breadth first walk of the packages depending on the given ones,
+    // visited only tracks what was emitted so a requested package that
+    // depends on another requested package is still reported
+    std::vector<bool> visited(cache->HeaderP->PackageCount, false);
+    std::vector<bool> queued(cache->HeaderP->PackageCount, false);
+    std::deque<pkgCache::PkgIterator> queue;
+    for (PkgList::const_iterator it = pkgs.begin(); it != pkgs.end(); ++it) {
+        const pkgCache::PkgIterator &pkg = it->ParentPkg();
+        if (!queued[pkg->ID]) {
+            queued[pkg->ID] = true;
+            queue.push_back(pkg);
         }
+    }
 
-        // Ignore packages that exist only due to dependencies.
-        if (parentPkg.VersionList().end() && parentPkg.ProvidesList().end()) {
-            continue;
+    while (!queue.empty()) {
+        if (cancelled()) {
+            break;
         }
 
-        // Don't insert virtual packages instead add what it provides
-        const pkgCache::VerIterator &parentVer = m_cache->findVer(parentPkg);
-        if (parentVer.end() == false) {
-            PkgList deps;
-            getDepends(deps, parentVer, false);
-            for (PkgList::const_iterator it = deps.begin(); it != deps.end(); ++it) {
-                if (*it == ver) {
-                    if (recursive) {
-                        if (!output.contains(parentPkg)) {
-                            output.push_back(parentVer);
-                            getRequires(output, parentVer, recursive);
-                        }
-                    } else {
-                        output.push_back(parentVer);
-                    }
-                    break;
-                }
+        const pkgCache::PkgIterator pkg = queue.front();
+        queue.pop_front();
+
+        ReverseDepends::const_iterator it;
+        for (it = revDepends.begin(pkg); it != revDepends.end(pkg); ++it) {
+            const pkgCache::PkgIterator parentPkg(*cache, cache->PkgP + *it);
+            if (visited[parentPkg->ID]) {
+                continue;
+            }
+            visited[parentPkg->ID] = true;
+
+            // Don't insert virtual packages
+            const pkgCache::VerIterator &parentVer = m_cache->findVer(parentPkg);
+            if (parentVer.end()) {
+                continue;
+            }
+
+            output.push_back(parentVer);
+            if (recursive && !queued[parentPkg->ID]) {
+                queued[parentPkg->ID] = true;
+                queue.push_back(parentPkg);
             }
         }
     }
 }
 
-PkgList AptIntf::getPackages()
+class AllPackagesScanner : public PkgScanner
 {
-    pk_backend_job_set_status(m_job, PK_STATUS_ENUM_QUERY);
+public:
+    AllPackagesScanner(AptCacheFile *cache) :
+        m_cache(cache)
+    {
+    }
 
-    PkgList output;
-    output.reserve(m_cache->GetPkgCache()->HeaderP->PackageCount);
-    for (pkgCache::PkgIterator pkg = m_cache->GetPkgCache()->PkgBegin(); !pkg.end(); ++pkg) {
-        if (m_cancel) {
-            break;
-        }
+    PkgScanner* clone() const
+    {
+        return new AllPackagesScanner(m_cache);
+    }
 
+    void scan(const pkgCache::PkgIterator &pkg, PkgList &output)
+    {
         // Ignore packages that exist only due to dependencies.
         if(pkg.VersionList().end() && pkg.ProvidesList().end()) {
-            continue;
+            return;
         }
 
         // Don't insert virtual packages as they don't have all kinds of info
@@ -1056,6 +1198,21 @@ PkgList AptIntf::getPackages()
             output.push_back(ver);
         }
     }
+
+private:
+    AptCacheFile *m_cache;
+};
+
+PkgList AptIntf::getPackages()
+{
+    pk_backend_job_set_status(m_job, PK_STATUS_ENUM_QUERY);
+
+    PkgList output;
+    output.reserve(m_cache->GetPkgCache()->HeaderP->PackageCount);
+
+    AllPackagesScanner scanner(m_cache);
+    scanner.run(m_cache->GetPkgCache(), output, m_cancel);
+
     return output;
 }
 
@@ -1066,7 +1223,7 @@ PkgList AptIntf::getPackagesFromRepo(SourcesList::SourceRecord *&rec)
     PkgList output;
     output.reserve(m_cache->GetPkgCache()->HeaderP->PackageCount);
     for (pkgCache::PkgIterator pkg = m_cache->GetPkgCache()->PkgBegin(); !pkg.end(); ++pkg) {
-        if (m_cancel) {
+        if (cancelled()) {
             break;
         }
 
@@ -1119,35 +1276,25 @@ PkgList AptIntf::getPackagesFromRepo(SourcesList::SourceRecord *&rec)
     return output;
 }
 
-PkgList AptIntf::getPackagesFromGroup(gchar **values)
+class GroupScanner : public PkgScanner
 {
-    pk_backend_job_set_status(m_job, PK_STATUS_ENUM_QUERY);
-
-    PkgList output;
-    vector<PkGroupEnum> groups;
-
-    int len = g_strv_length(values);
-    for (uint i = 0; i < len; i++) {
-        if (values[i] == NULL) {
-            pk_backend_job_error_code(m_job,
-                                      PK_ERROR_ENUM_GROUP_NOT_FOUND,
-                                      "An empty group was received");
-            pk_backend_job_finished(m_job);
-            return output;
-        } else {
-            groups.push_back(pk_group_enum_from_string(values[i]));
-        }
+public:
+    GroupScanner(AptCacheFile *cache, const vector<PkGroupEnum> &groups) :
+        m_cache(cache),
+        m_groups(groups)
+    {
     }
 
-    pk_backend_job_set_allow_cancel(m_job, true);
+    PkgScanner* clone() const
+    {
+        return new GroupScanner(m_cache, m_groups);
+    }
 
-    for (pkgCache::PkgIterator pkg = m_cache->GetPkgCache()->PkgBegin(); !pkg.end(); ++pkg) {
-        if (m_cancel) {
-            break;
-        }
+    void scan(const pkgCache::PkgIterator &pkg, PkgList &output)
+    {
         // Ignore packages that exist only due to dependencies.
         if (pkg.VersionList().end() && pkg.ProvidesList().end()) {
-            continue;
+            return;
         }
 
         // Ignore virtual packages
@@ -1160,8 +1307,8 @@ PkgList AptIntf::getPackagesFromGroup(gchar **values)
             section = section.substr(found + 1);
 
             // Don't insert virtual packages instead add what it provides
-            for (vector<PkGroupEnum>::const_iterator it = groups.begin();
-                 it != groups.end();
+            for (vector<PkGroupEnum>::const_iterator it = m_groups.begin();
+                 it != m_groups.end();
                  ++it) {
                 if (*it == get_enum_group(section)) {
                     output.push_back(ver);
@@ -1170,30 +1317,62 @@ PkgList AptIntf::getPackagesFromGroup(gchar **values)
             }
         }
     }
+
+private:
+    AptCacheFile *m_cache;
+    vector<PkGroupEnum> m_groups;
+};
+
+PkgList AptIntf::getPackagesFromGroup(gchar **values)
+{
+    pk_backend_job_set_status(m_job, PK_STATUS_ENUM_QUERY);
+
+    PkgList output;
+    vector<PkGroupEnum> groups;
+
+    int len = g_strv_length(values);
+    for (uint i = 0; i < len; i++) {
+        if (values[i] == NULL) {
+            pk_backend_job_error_code(m_job,
+                                      PK_ERROR_ENUM_GROUP_NOT_FOUND,
+                                      "An empty group was received");
+            pk_backend_job_finished(m_job);
+            return output;
+        } else {
+            groups.push_back(pk_group_enum_from_string(values[i]));
+        }
+    }
+
+    pk_backend_job_set_allow_cancel(m_job, true);
+
+    GroupScanner scanner(m_cache, groups);
+    scanner.run(m_cache->GetPkgCache(), output, m_cancel);
+
     return output;
 }
 
-PkgList AptIntf::searchPackageName(gchar *search)
+class NameScanner : public PkgScanner
 {
-    PkgList output;
+public:
+    NameScanner(AptCacheFile *cache, const Matcher *matcher) :
+        m_cache(cache),
+        m_matcher(matcher)
+    {
+    }
 
-    Matcher *matcher = new Matcher(search);
-    if (matcher->hasError()) {
-        g_debug("Regex compilation error");
-        delete matcher;
-        return output;
+    PkgScanner* clone() const
+    {
+        return new NameScanner(m_cache, m_matcher);
     }
 
-    for (pkgCache::PkgIterator pkg = m_cache->GetPkgCache()->PkgBegin(); !pkg.end(); ++pkg) {
-        if (m_cancel) {
-            break;
-        }
+    void scan(const pkgCache::PkgIterator &pkg, PkgList &output)
+    {
         // Ignore packages that exist only due to dependencies.
         if (pkg.VersionList().end() && pkg.ProvidesList().end()) {
-            continue;
+            return;
         }
 
-        if (matcher->matches(pkg.Name())) {
+        if (m_matcher->matches(pkg.Name())) {
             // Don't insert virtual packages instead add what it provides
             const pkgCache::VerIterator &ver = m_cache->findVer(pkg);
             if (ver.end() == false) {
@@ -1213,6 +1392,27 @@ PkgList AptIntf::searchPackageName(gchar *search)
             }
         }
     }
+
+private:
+    AptCacheFile *m_cache;
+    const Matcher *m_matcher;
+};
+
+PkgList AptIntf::searchPackageName(gchar *search)
+{
+    PkgList output;
+
+    Matcher *matcher = new Matcher(search);
+    if (matcher->hasError()) {
+        g_debug("Regex compilation error");
+        delete matcher;
+        return output;
+    }
+
+    NameScanner scanner(m_cache, matcher);
+    scanner.run(m_cache->GetPkgCache(), output, m_cancel);
+
+    delete matcher;
     return output;
 }
 
@@ -1227,8 +1427,11 @@ PkgList AptIntf::searchPackageDetails(gchar *search)
         return output;
     }
 
+    // Read the descriptions only once per cache
+    const DescriptionCorpus &descriptions = m_cache->descriptions();
+
     for (pkgCache::PkgIterator pkg = m_cache->GetPkgCache()->PkgBegin(); !pkg.end(); ++pkg) {
-        if (m_cancel) {
+        if (cancelled()) {
             break;
         }
         // Ignore packages that exist only due to dependencies.
@@ -1238,8 +1441,10 @@ PkgList AptIntf::searchPackageDetails(gchar *search)
 
         const pkgCache::VerIterator &ver = m_cache->findVer(pkg);
         if (ver.end() == false) {
+            size_t length;
+            const char *description = descriptions.description(pkg, length);
             if (matcher->matches(pkg.Name()) ||
-                    matcher->matches((*m_cache).getLongDescription(ver))) {
+                    matcher->matchesLowercase(description, length)) {
                 // The package matched
                 output.push_back(ver);
             }
@@ -1260,6 +1465,8 @@ PkgList AptIntf::searchPackageDetails(gchar *search)
             }
         }
     }
+
+    delete matcher;
     return output;
 }
 
@@ -1267,58 +1474,12 @@ PkgList AptIntf::searchPackageDetails(gchar *search)
 PkgList AptIntf::searchPackageFiles(gchar **values)
 {
     PkgList output;
-    vector<string> packages;
-    regex_t re;
-    gchar *search;
-    gchar *values_str;
-
-    values_str = g_strjoinv("$|^", values);
-    search = g_strdup_printf("^%s$",
-                             values_str);
-    g_free(values_str);
-    if(regcomp(&re, search, REG_NOSUB) != 0) {
-        g_debug("Regex compilation error");
-        g_free(search);
-        return output;
-    }
-    g_free(search);
-
-    DIR *dp;
-    struct dirent *dirp;
-    if (!(dp = opendir("/var/lib/dpkg/info/"))) {
-        g_debug ("Error opening /var/lib/dpkg/info/\n");
-        regfree(&re);
-        return output;
-    }
-
-    string line;
-    while ((dirp = readdir(dp)) != NULL) {
-        if (m_cancel) {
-            break;
-        }
-        if (ends_with(dirp->d_name, ".list")) {
-            string f = "/var/lib/dpkg/info/" + string(dirp->d_name);
-            ifstream in(f.c_str());
-            if (!in != 0) {
-                continue;
-            }
-            while (!in.eof()) {
-                getline(in, line);
-                if (regexec(&re, line.c_str(), (size_t)0, NULL, 0) == 0) {
-                    string file(dirp->d_name);
-                    packages.push_back(file.erase(file.size() - 5, file.size()));
-                    break;
-                }
-            }
-        }
-    }
-    closedir(dp);
-    regfree(&re);
+    const vector<string> &packages = DpkgFileIndex::findOwners(values);
 
     // Resolve the package names now
     for (vector<string>::const_iterator it = packages.begin();
         it != packages.end(); ++it) {
-        if (m_cancel) {
+        if (cancelled()) {
             break;
         }
         const pkgCache::PkgIterator &pkg = (*m_cache)->FindPkg(*it);
@@ -1368,68 +1529,12 @@ PkgList AptIntf::getUpdates(PkgList &blocked)
 // used to return files it reads, using the info from the files in /var/lib/dpkg/info/
 void AptIntf::providesMimeType(PkgList &output, gchar **values)
 {
-    regex_t re;
-    gchar *value;
-    gchar *values_str;
-
-    values_str = g_strjoinv("|", values);
-    value = g_strdup_printf("^MimeType=\\(.*;\\)\\?\\(%s\\)\\(;.*\\)\\?$",
-                            values_str);
-    g_free(values_str);
-
-    if(regcomp(&re, value, REG_NOSUB) != 0) {
-        g_debug("Regex compilation error");
-        g_free(value);
-        return;
-    }
-    g_free(value);
-
-    DIR *dp;
-    struct dirent *dirp;
-    if (!(dp = opendir("/usr/share/app-install/desktop/"))) {
-        g_debug ("Error opening /usr/share/app-install/desktop/\n");
-        regfree(&re);
-        return;
-    }
-
-    vector<string> packages;
-    string line;
-    while ((dirp = readdir(dp)) != NULL) {
-        if (m_cancel) {
-            break;
-        }
-        if (ends_with(dirp->d_name, ".desktop")) {
-            string f = "/usr/share/app-install/desktop/" + string(dirp->d_name);
-            ifstream in(f.c_str());
-            if (!in != 0) {
-                continue;
-            }
-            bool getName = false;
-            while (!in.eof()) {
-                getline(in, line);
-                if (getName) {
-                    if (starts_with(line, "X-AppInstall-Package=")) {
-                        // Remove the X-AppInstall-Package=
-                        packages.push_back(line.substr(21));
-                        break;
-                    }
-                } else {
-                    if (regexec(&re, line.c_str(), (size_t)0, NULL, 0) == 0) {
-                        in.seekg(ios_base::beg);
-                        getName = true;
-                    }
-                }
-            }
-        }
-    }
-
-    closedir(dp);
-    regfree(&re);
+    const vector<string> &packages = MimeTypeIndex::findPackages(values);
 
     // resolve the package names
     for (vector<string>::const_iterator it = packages.begin();
          it != packages.end(); ++it) {
-        if (m_cancel) {
+        if (cancelled()) {
             break;
         }
         const pkgCache::PkgIterator &pkg = (*m_cache)->FindPkg(*it);
@@ -1504,49 +1609,31 @@ bool AptIntf::isApplication(const pkgCache::VerIterator &ver)
 void AptIntf::emitPackageFiles(const gchar *pi)
 {
     GPtrArray *files;
-    string line;
     gchar **parts;
+    vector<string> list;
 
     parts = pk_package_id_split(pi);
 
-    string fName;
+    bool found;
+    const string name = parts[PK_PACKAGE_ID_NAME];
     if (m_isMultiArch) {
-        fName = "/var/lib/dpkg/info/" +
-                string(parts[PK_PACKAGE_ID_NAME]) +
-                ":" +
-                string(parts[PK_PACKAGE_ID_ARCH]) +
-                ".list";
-        if (!FileExists(fName)) {
+        found = DpkgFileIndex::packageFiles(name + ":" + parts[PK_PACKAGE_ID_ARCH], list);
+        if (!found) {
             // if the file was not found try without the arch field
-            fName = "/var/lib/dpkg/info/" +
-                    string(parts[PK_PACKAGE_ID_NAME]) +
-                    ".list";
+            found = DpkgFileIndex::packageFiles(name, list);
         }
     } else {
-        fName = "/var/lib/dpkg/info/" +
-                string(parts[PK_PACKAGE_ID_NAME]) +
-                ".list";
+        found = DpkgFileIndex::packageFiles(name, list);
     }
     g_strfreev (parts);
 
-    if (FileExists(fName)) {
-        ifstream in(fName.c_str());
-        if (!in != 0) {
-            return;
-        }
-
-        files = g_ptr_array_new_with_free_func(g_free);
-        while (in.eof() == false) {
-            getline(in, line);
-            if (!line.empty()) {
-                g_ptr_array_add(files, g_strdup(line.c_str()));
-            }
-        }
-
-        if (files->len) {
-            g_ptr_array_add(files, NULL);
-            pk_backend_job_files(m_job, pi, (gchar **) files->pdata);
+    if (found && !list.empty()) {
+        files = g_ptr_array_new_full(list.size() + 1, NULL);
+        for (vector<string>::const_iterator it = list.begin(); it != list.end(); ++it) {
+            g_ptr_array_add(files, (gpointer) it->c_str());
         }
+        g_ptr_array_add(files, NULL);
+        pk_backend_job_files(m_job, pi, (gchar **) files->pdata);
         g_ptr_array_unref(files);
     }
 }
@@ -1728,141 +1815,175 @@ pkgCache::VerIterator AptIntf::findTransactionPackage(const std::string &name)
     return candidateVer;
 }
 
+// Splits the next ':' separated field off a status line in place,
+// the last field takes the rest of the line
+static char* nextStatusField(char **cursor, bool last)
+{
+    char *field = *cursor;
+    if (field == NULL) {
+        return NULL;
+    }
+
+    char *end = last ? NULL : strchr(field, ':');
+    if (end) {
+        *end = '\0';
+        *cursor = end + 1;
+    } else {
+        *cursor = NULL;
+    }
+
+    return g_strstrip(field);
+}
+
+// Returns the text between the next pair of quotes after *cursor
+static string nextQuoted(const char **cursor)
+{
+    const char *start = strchr(*cursor, '\'');
+    if (start == NULL) {
+        return string();
+    }
+    start++;
+
+    const char *end = strchr(start, '\'');
+    if (end == NULL) {
+        *cursor = start + strlen(start);
+        return string(start);
+    }
+    *cursor = end + 1;
+
+    return string(start, end - start);
+}
+
 void AptIntf::updateInterface(int fd, int writeFd)
 {
-    char buf[2];
-    static char line[1024] = "";
+    char buf[4096];
 
+    // Read everything dpkg wrote since the last call, a line may
+    // be split across reads so the remainder is kept for the next one
     while (1) {
-        // This algorithm should be improved (it's the same as the rpm one ;)
-        int len = read(fd, buf, 1);
+        ssize_t len = read(fd, buf, sizeof(buf));
 
         // nothing was read
-        if(len < 1) {
+        if (len < 1) {
             break;
         }
+        m_statusBuffer.append(buf, len);
 
         // update the time we last saw some action
         m_lastTermAction = time(NULL);
+    }
 
-        if( buf[0] == '\n') {
-            if (m_cancel) {
-                kill(m_child_pid, SIGTERM);
-            }
-            //cout << "got line: " << line << endl;
+    size_t start = 0;
+    size_t newline;
+    while ((newline = m_statusBuffer.find('\n', start)) != string::npos) {
+        // The line is tokenized in place in the buffer
+        char *line = &m_statusBuffer[start];
+        m_statusBuffer[newline] = '\0';
+        start = newline + 1;
 
-            gchar **split  = g_strsplit(line, ":",5);
-            gchar *status  = g_strstrip(split[0]);
-            gchar *pkg     = g_strstrip(split[1]);
-            gchar *percent = g_strstrip(split[2]);
-            gchar *str     = g_strdup(g_strstrip(split[3]));
+        if (cancelled()) {
+            kill(m_child_pid, SIGTERM);
+        }
+        //cout << "got line: " << line << endl;
 
-            // major problem here, we got unexpected input. should _never_ happen
-            if(!(pkg && status)) {
-                continue;
+        char *cursor = line;
+        const char *status  = nextStatusField(&cursor, false);
+        const char *pkg     = nextStatusField(&cursor, false);
+        const char *percent = nextStatusField(&cursor, false);
+        const char *str     = nextStatusField(&cursor, true);
+
+        // major problem here, we got unexpected input. should _never_ happen
+        if (!(pkg && status)) {
+            continue;
+        }
+        if (str == NULL) {
+            str = "";
+        }
+
+        // Since PackageKit doesn't emulate finished anymore
+        // we need to manually do it here, as at this point
+        // dpkg doesn't process two packages at the same time
+        if (!m_lastPackage.empty() && m_lastPackage.compare(pkg) != 0) {
+            const pkgCache::VerIterator &ver = findTransactionPackage(m_lastPackage);
+            if (!ver.end()) {
+                emitPackage(ver, PK_INFO_ENUM_FINISHED);
             }
+            m_lastSubProgress = 0;
+        }
 
-            // Since PackageKit doesn't emulate finished anymore
-            // we need to manually do it here, as at this point
-            // dpkg doesn't process two packages at the same time
-            if (!m_lastPackage.empty() && m_lastPackage.compare(pkg) != 0) {
-                const pkgCache::VerIterator &ver = findTransactionPackage(m_lastPackage);
-                if (!ver.end()) {
-                    emitPackage(ver, PK_INFO_ENUM_FINISHED);
-                }
-                m_lastSubProgress = 0;
+        // first check for errors and conf-file prompts
+        if (strstr(status, "pmerror") != NULL) {
+            // error from dpkg
+            pk_backend_job_error_code(m_job,
+                                      PK_ERROR_ENUM_PACKAGE_FAILED_TO_INSTALL,
+                                      "Error while installing package: %s",
+                                      str);
+        } else if (strstr(status, "pmconffile") != NULL) {
+            // conffile-request from dpkg, needs to be parsed different
+            // the message is: 'orig_file' 'new_file' useredited distedited
+            const char *quoted = str;
+            string orig_file = nextQuoted(&quoted);
+            string new_file = nextQuoted(&quoted);
+
+            gchar *filename;
+            filename = g_build_filename(DATADIR, "PackageKit", "helpers", "aptcc", "pkconffile", NULL);
+            gchar **argv;
+            gchar **envp;
+            GError *error = NULL;
+            argv = (gchar **) g_malloc(5 * sizeof(gchar *));
+            argv[0] = filename;
+            argv[1] = g_strdup(m_lastPackage.c_str());
+            argv[2] = g_strdup(orig_file.c_str());
+            argv[3] = g_strdup(new_file.c_str());
+            argv[4] = NULL;
+
+            gchar *socket;
+            if (socket = pk_backend_job_get_frontend_socket(m_job)) {
+                envp = (gchar **) g_malloc(3 * sizeof(gchar *));
+                envp[0] = g_strdup("DEBIAN_FRONTEND=passthrough");
+                envp[1] = g_strdup_printf("DEBCONF_PIPE=%s", socket);
+                envp[2] = NULL;
+            } else {
+                // we don't have a socket set, let's fallback to noninteractive
+                envp = (gchar **) g_malloc(2 * sizeof(gchar *));
+                envp[0] = g_strdup("DEBIAN_FRONTEND=noninteractive");
+                envp[1] = NULL;
             }
 
-            // first check for errors and conf-file prompts
-            if (strstr(status, "pmerror") != NULL) {
-                // error from dpkg
-                pk_backend_job_error_code(m_job,
-                                          PK_ERROR_ENUM_PACKAGE_FAILED_TO_INSTALL,
-                                          "Error while installing package: %s",
-                                          str);
-            } else if (strstr(status, "pmconffile") != NULL) {
-                // conffile-request from dpkg, needs to be parsed different
-                int i=0;
-                int count=0;
-                string orig_file, new_file;
-
-                // go to first ' and read until the end
-                for(;str[i] != '\'' || str[i] == 0; i++)
-                    /*nothing*/
-                    ;
-                i++;
-                for(;str[i] != '\'' || str[i] == 0; i++)
-                    orig_file.append(1, str[i]);
-                i++;
-
-                // same for second ' and read until the end
-                for(;str[i] != '\'' || str[i] == 0; i++)
-                    /*nothing*/
-                    ;
-                i++;
-                for(;str[i] != '\'' || str[i] == 0; i++)
-                    new_file.append(1, str[i]);
-                i++;
-
-                gchar *filename;
-                filename = g_build_filename(DATADIR, "PackageKit", "helpers", "aptcc", "pkconffile", NULL);
-                gchar **argv;
-                gchar **envp;
-                GError *error = NULL;
-                argv = (gchar **) g_malloc(5 * sizeof(gchar *));
-                argv[0] = filename;
-                argv[1] = g_strdup(m_lastPackage.c_str());
-                argv[2] = g_strdup(orig_file.c_str());
-                argv[3] = g_strdup(new_file.c_str());
-                argv[4] = NULL;
-
-                gchar *socket;
-                if (socket = pk_backend_job_get_frontend_socket(m_job)) {
-                    envp = (gchar **) g_malloc(3 * sizeof(gchar *));
-                    envp[0] = g_strdup("DEBIAN_FRONTEND=passthrough");
-                    envp[1] = g_strdup_printf("DEBCONF_PIPE=%s", socket);
-                    envp[2] = NULL;
-                } else {
-                    // we don't have a socket set, let's fallback to noninteractive
-                    envp = (gchar **) g_malloc(2 * sizeof(gchar *));
-                    envp[0] = g_strdup("DEBIAN_FRONTEND=noninteractive");
-                    envp[1] = NULL;
+            gboolean ret;
+            gint exitStatus;
+            ret = g_spawn_sync(NULL, // working dir
+                               argv, // argv
+                               envp, // envp
+                               G_SPAWN_LEAVE_DESCRIPTORS_OPEN,
+                               NULL, // child_setup
+                               NULL, // user_data
+                               NULL, // standard_output
+                               NULL, // standard_error
+                               &exitStatus,
+                               &error);
+
+            int exit_code = WEXITSTATUS(exitStatus);
+            cout << filename << " " << exit_code << " ret: "<< ret << endl;
+
+            g_free(filename);
+            g_strfreev(argv);
+            g_strfreev(envp);
+
+            if (exit_code == 10) {
+                // 1 means the user wants the package config
+                if (write(writeFd, "Y\n", 2) != 2) {
+                    // TODO we need a DPKG patch to use debconf
+                    g_debug("Failed to write");
                 }
-
-                gboolean ret;
-                gint exitStatus;
-                ret = g_spawn_sync(NULL, // working dir
-                                   argv, // argv
-                                   envp, // envp
-                                   G_SPAWN_LEAVE_DESCRIPTORS_OPEN,
-                                   NULL, // child_setup
-                                   NULL, // user_data
-                                   NULL, // standard_output
-                                   NULL, // standard_error
-                                   &exitStatus,
-                                   &error);
-
-                int exit_code = WEXITSTATUS(exitStatus);
-                cout << filename << " " << exit_code << " ret: "<< ret << endl;
-
-                g_free(filename);
-                g_strfreev(argv);
-                g_strfreev(envp);
-
-                if (exit_code == 10) {
-                    // 1 means the user wants the package config
-                    if (write(writeFd, "Y\n", 2) != 2) {
-                        // TODO we need a DPKG patch to use debconf
-                        g_debug("Failed to write");
-                    }
-                } else if (exit_code == 20) {
-                    // 2 means the user wants to keep the current config
-                    if (write(writeFd, "N\n", 2) != 2) {
-                        // TODO we need a DPKG patch to use debconf
-                        g_debug("Failed to write");
-                    }
-                } else {
-                    // either the user didn't choose an option or the front end failed'
+            } else if (exit_code == 20) {
+                // 2 means the user wants to keep the current config
+                if (write(writeFd, "N\n", 2) != 2) {
+                    // TODO we need a DPKG patch to use debconf
+                    g_debug("Failed to write");
+                }
+            } else {
+                // either the user didn't choose an option or the front end failed'
 //                     pk_backend_job_message(m_job,
 //                                            PK_MESSAGE_ENUM_CONFIG_FILES_CHANGED,
 //                                            "The configuration file '%s' "
@@ -1871,169 +1992,162 @@ void AptIntf::updateInterface(int fd, int writeFd)
 //                                            "Please verify your changes and update it manually.",
 //                                            orig_file.c_str(),
 //                                            new_file.c_str());
-                    // fall back to keep the current config file
-                    if (write(writeFd, "N\n", 2) != 2) {
-                        // TODO we need a DPKG patch to use debconf
-                        g_debug("Failed to write");
-                    }
+                // fall back to keep the current config file
+                if (write(writeFd, "N\n", 2) != 2) {
+                    // TODO we need a DPKG patch to use debconf
+                    g_debug("Failed to write");
                 }
-            } else if (strstr(status, "pmstatus") != NULL) {
-                // INSTALL & UPDATE
-                // - Running dpkg
-                // loops ALL
-                // -  0 Installing pkg (sometimes this is skiped)
-                // - 25 Preparing pkg
-                // - 50 Unpacking pkg
-                // - 75 Preparing to configure pkg
-                //   ** Some pkgs have
-                //   - Running post-installation
-                //   - Running dpkg
-                // reloops all
-                // -   0 Configuring pkg
-                // - +25 Configuring pkg (SOMETIMES)
-                // - 100 Installed pkg
-                // after all
-                // - Running post-installation
-
-                // REMOVE
-                // - Running dpkg
-                // loops
-                // - 25  Removing pkg
-                // - 50  Preparing for removal of pkg
-                // - 75  Removing pkg
-                // - 100 Removed pkg
-                // after all
-                // - Running post-installation
-
-                // Let's start parsing the status:
-                if (starts_with(str, "Preparing to configure")) {
-                    // Preparing to Install/configure
-                    // cout << "Found Preparing to configure! " << line << endl;
-                    // The next item might be Configuring so better it be 100
-                    m_lastSubProgress = 100;
-                    const pkgCache::VerIterator &ver = findTransactionPackage(pkg);
-                    if (!ver.end()) {
-                        emitPackage(ver, PK_INFO_ENUM_PREPARING);
-                        emitPackageProgress(ver, 75);
-                    }
-                } else if (starts_with(str, "Preparing for removal")) {
-                    // Preparing to Install/configure
-                    // cout << "Found Preparing for removal! " << line << endl;
-                    m_lastSubProgress = 50;
-                    const pkgCache::VerIterator &ver = findTransactionPackage(pkg);
-                    if (!ver.end()) {
-                        emitPackage(ver, PK_INFO_ENUM_REMOVING);
-                        emitPackageProgress(ver, m_lastSubProgress);
-                    }
-                } else if (starts_with(str, "Preparing")) {
-                    // Preparing to Install/configure
-                    // cout << "Found Preparing! " << line << endl;
-                    const pkgCache::VerIterator &ver = findTransactionPackage(pkg);
-                    if (!ver.end()) {
-                        emitPackage(ver, PK_INFO_ENUM_PREPARING);
-                        emitPackageProgress(ver, 25);
-                    }
-                } else if (starts_with(str, "Unpacking")) {
-                    // cout << "Found Unpacking! " << line << endl;
-                    const pkgCache::VerIterator &ver = findTransactionPackage(pkg);
-                    if (!ver.end()) {
-                        emitPackage(ver, PK_INFO_ENUM_DECOMPRESSING);
-                        emitPackageProgress(ver, 50);
-                    }
-                } else if (starts_with(str, "Configuring")) {
-                    // Installing Package
-                    // cout << "Found Configuring! " << line << endl;
-                    if (m_lastSubProgress >= 100 && !m_lastPackage.empty()) {
-                        // cout << "FINISH the last package: " << m_lastPackage << endl;
-                        const pkgCache::VerIterator &ver = findTransactionPackage(m_lastPackage);
-                        if (!ver.end()) {
-                            emitPackage(ver, PK_INFO_ENUM_FINISHED);
-                        }
-                        m_lastSubProgress = 0;
-                    }
-
-                    const pkgCache::VerIterator &ver = findTransactionPackage(pkg);
+            }
+        } else if (strstr(status, "pmstatus") != NULL) {
+            // INSTALL & UPDATE
+            // - Running dpkg
+            // loops ALL
+            // -  0 Installing pkg (sometimes this is skiped)
+            // - 25 Preparing pkg
+            // - 50 Unpacking pkg
+            // - 75 Preparing to configure pkg
+            //   ** Some pkgs have
+            //   - Running post-installation
+            //   - Running dpkg
+            // reloops all
+            // -   0 Configuring pkg
+            // - +25 Configuring pkg (SOMETIMES)
+            // - 100 Installed pkg
+            // after all
+            // - Running post-installation
+
+            // REMOVE
+            // - Running dpkg
+            // loops
+            // - 25  Removing pkg
+            // - 50  Preparing for removal of pkg
+            // - 75  Removing pkg
+            // - 100 Removed pkg
+            // after all
+            // - Running post-installation
+
+            // Let's start parsing the status:
+            if (g_str_has_prefix(str, "Preparing to configure")) {
+                // Preparing to Install/configure
+                // cout << "Found Preparing to configure! " << line << endl;
+                // The next item might be Configuring so better it be 100
+                m_lastSubProgress = 100;
+                const pkgCache::VerIterator &ver = findTransactionPackage(pkg);
+                if (!ver.end()) {
+                    emitPackage(ver, PK_INFO_ENUM_PREPARING);
+                    emitPackageProgress(ver, 75);
+                }
+            } else if (g_str_has_prefix(str, "Preparing for removal")) {
+                // Preparing to Install/configure
+                // cout << "Found Preparing for removal! " << line << endl;
+                m_lastSubProgress = 50;
+                const pkgCache::VerIterator &ver = findTransactionPackage(pkg);
+                if (!ver.end()) {
+                    emitPackage(ver, PK_INFO_ENUM_REMOVING);
+                    emitPackageProgress(ver, m_lastSubProgress);
+                }
+            } else if (g_str_has_prefix(str, "Preparing")) {
+                // Preparing to Install/configure
+                // cout << "Found Preparing! " << line << endl;
+                const pkgCache::VerIterator &ver = findTransactionPackage(pkg);
+                if (!ver.end()) {
+                    emitPackage(ver, PK_INFO_ENUM_PREPARING);
+                    emitPackageProgress(ver, 25);
+                }
+            } else if (g_str_has_prefix(str, "Unpacking")) {
+                // cout << "Found Unpacking! " << line << endl;
+                const pkgCache::VerIterator &ver = findTransactionPackage(pkg);
+                if (!ver.end()) {
+                    emitPackage(ver, PK_INFO_ENUM_DECOMPRESSING);
+                    emitPackageProgress(ver, 50);
+                }
+            } else if (g_str_has_prefix(str, "Configuring")) {
+                // Installing Package
+                // cout << "Found Configuring! " << line << endl;
+                if (m_lastSubProgress >= 100 && !m_lastPackage.empty()) {
+                    // cout << "FINISH the last package: " << m_lastPackage << endl;
+                    const pkgCache::VerIterator &ver = findTransactionPackage(m_lastPackage);
                     if (!ver.end()) {
-                        emitPackage(ver, PK_INFO_ENUM_INSTALLING);
-                        emitPackageProgress(ver, m_lastSubProgress);
-                    }
-                    m_lastSubProgress += 25;
-                } else if (starts_with(str, "Running dpkg")) {
-                    // cout << "Found Running dpkg! " << line << endl;
-                } else if (starts_with(str, "Running")) {
-                    // cout << "Found Running! " << line << endl;
-                    pk_backend_job_set_status (m_job, PK_STATUS_ENUM_COMMIT);
-                } else if (starts_with(str, "Installing")) {
-                    // cout << "Found Installing! " << line << endl;
-                    // FINISH the last package
-                    if (!m_lastPackage.empty()) {
-                        // cout << "FINISH the last package: " << m_lastPackage << endl;
-                        const pkgCache::VerIterator &ver = findTransactionPackage(m_lastPackage);
-                        if (!ver.end()) {
-                            emitPackage(ver, PK_INFO_ENUM_FINISHED);
-                        }
+                        emitPackage(ver, PK_INFO_ENUM_FINISHED);
                     }
                     m_lastSubProgress = 0;
-                    const pkgCache::VerIterator &ver = findTransactionPackage(pkg);
-                    if (!ver.end()) {
-                        emitPackage(ver, PK_INFO_ENUM_INSTALLING);
-                        emitPackageProgress(ver, m_lastSubProgress);
-                    }
-                } else if (starts_with(str, "Removing")) {
-                    // cout << "Found Removing! " << line << endl;
-                    if (m_lastSubProgress >= 100 && !m_lastPackage.empty()) {
-                        // cout << "FINISH the last package: " << m_lastPackage << endl;
-                        const pkgCache::VerIterator &ver = findTransactionPackage(m_lastPackage);
-                        if (!ver.end()) {
-                            emitPackage(ver, PK_INFO_ENUM_FINISHED);
-                        }
-                    }
-                    m_lastSubProgress += 25;
+                }
 
-                    const pkgCache::VerIterator &ver = findTransactionPackage(pkg);
+                const pkgCache::VerIterator &ver = findTransactionPackage(pkg);
+                if (!ver.end()) {
+                    emitPackage(ver, PK_INFO_ENUM_INSTALLING);
+                    emitPackageProgress(ver, m_lastSubProgress);
+                }
+                m_lastSubProgress += 25;
+            } else if (g_str_has_prefix(str, "Running dpkg")) {
+                // cout << "Found Running dpkg! " << line << endl;
+            } else if (g_str_has_prefix(str, "Running")) {
+                // cout << "Found Running! " << line << endl;
+                pk_backend_job_set_status (m_job, PK_STATUS_ENUM_COMMIT);
+            } else if (g_str_has_prefix(str, "Installing")) {
+                // cout << "Found Installing! " << line << endl;
+                // FINISH the last package
+                if (!m_lastPackage.empty()) {
+                    // cout << "FINISH the last package: " << m_lastPackage << endl;
+                    const pkgCache::VerIterator &ver = findTransactionPackage(m_lastPackage);
                     if (!ver.end()) {
-                        emitPackage(ver, PK_INFO_ENUM_REMOVING);
-                        emitPackageProgress(ver, m_lastSubProgress);
+                        emitPackage(ver, PK_INFO_ENUM_FINISHED);
                     }
-                } else if (starts_with(str, "Installed") ||
-                           starts_with(str, "Removed")) {
-                    // cout << "Found FINISHED! " << line << endl;
-                    m_lastSubProgress = 100;
-                    const pkgCache::VerIterator &ver = findTransactionPackage(pkg);
+                }
+                m_lastSubProgress = 0;
+                const pkgCache::VerIterator &ver = findTransactionPackage(pkg);
+                if (!ver.end()) {
+                    emitPackage(ver, PK_INFO_ENUM_INSTALLING);
+                    emitPackageProgress(ver, m_lastSubProgress);
+                }
+            } else if (g_str_has_prefix(str, "Removing")) {
+                // cout << "Found Removing! " << line << endl;
+                if (m_lastSubProgress >= 100 && !m_lastPackage.empty()) {
+                    // cout << "FINISH the last package: " << m_lastPackage << endl;
+                    const pkgCache::VerIterator &ver = findTransactionPackage(m_lastPackage);
                     if (!ver.end()) {
                         emitPackage(ver, PK_INFO_ENUM_FINISHED);
-//                         emitPackageProgress(ver, m_lastSubProgress);
                     }
-                } else {
-                    cout << ">>>Unmaped value<<< :" << line << endl;
                 }
+                m_lastSubProgress += 25;
 
-                if (!starts_with(str, "Running")) {
-                    m_lastPackage = pkg;
+                const pkgCache::VerIterator &ver = findTransactionPackage(pkg);
+                if (!ver.end()) {
+                    emitPackage(ver, PK_INFO_ENUM_REMOVING);
+                    emitPackageProgress(ver, m_lastSubProgress);
+                }
+            } else if (g_str_has_prefix(str, "Installed") ||
+                       g_str_has_prefix(str, "Removed")) {
+                // cout << "Found FINISHED! " << line << endl;
+                m_lastSubProgress = 100;
+                const pkgCache::VerIterator &ver = findTransactionPackage(pkg);
+                if (!ver.end()) {
+                    emitPackage(ver, PK_INFO_ENUM_FINISHED);
+//                         emitPackageProgress(ver, m_lastSubProgress);
                 }
-                m_startCounting = true;
             } else {
-                m_startCounting = true;
+                cout << ">>>Unmaped value<<< :" << pkg << ":" << str << endl;
             }
 
-            int val = atoi(percent);
-            //cout << "progress: " << val << endl;
-            pk_backend_job_set_percentage(m_job, val);
-
-            // clean-up
-            g_strfreev(split);
-            g_free(str);
-            line[0] = 0;
+            if (!g_str_has_prefix(str, "Running")) {
+                m_lastPackage = pkg;
+            }
+            m_startCounting = true;
         } else {
-            buf[1] = 0;
-            strcat(line, buf);
+            m_startCounting = true;
         }
+
+        int val = atoi(percent ? percent : "");
+        //cout << "progress: " << val << endl;
+        pk_backend_job_set_percentage(m_job, val);
     }
 
+    // Keep only the partial line
+    m_statusBuffer.erase(0, start);
+
     time_t now = time(NULL);
 
-    if(!m_startCounting) {
-        usleep(100000);
+    if (!m_startCounting) {
         // wait until we get the first message from apt
         m_lastTermAction = now;
     }
@@ -2045,8 +2159,14 @@ void AptIntf::updateInterface(int fd, int writeFd)
         m_lastTermAction = time(NULL);
     }
 
-    // sleep for a while to don't obcess over it
-    usleep(5000);
+    // sleep until dpkg writes something, either to the status
+    // fd or to the terminal, instead of polling the pipes
+    struct pollfd fds[2];
+    fds[0].fd = fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = writeFd;
+    fds[1].events = POLLIN;
+    poll(fds, 2, 100);
 }
 
 PkgList AptIntf::resolvePackageIds(gchar **package_ids, PkBitfield filters)
@@ -2062,7 +2182,7 @@ PkgList AptIntf::resolvePackageIds(gchar **package_ids, PkBitfield filters)
     }
 
     for (uint i = 0; i < g_strv_length(package_ids); ++i) {
-        if (m_cancel) {
+        if (cancelled()) {
             break;
         }
 
@@ -2077,7 +2197,7 @@ PkgList AptIntf::resolvePackageIds(gchar **package_ids, PkBitfield filters)
                 // search the whole package cache and match the package
                 // name manually
                 for (pkgCache::PkgIterator pkg = m_cache->GetPkgCache()->PkgBegin(); !pkg.end(); ++pkg) {
-                    if (m_cancel) {
+                    if (cancelled()) {
                         break;
                     }
 
@@ -2164,7 +2284,7 @@ void AptIntf::refreshCache()
 void AptIntf::markAutoInstalled(const PkgList &pkgs)
 {
     for (PkgList::const_iterator it = pkgs.begin(); it != pkgs.end(); ++it) {
-        if (m_cancel) {
+        if (cancelled()) {
             break;
         }
 
@@ -2391,7 +2511,7 @@ bool AptIntf::runTransaction(const PkgList &install, const PkgList &remove, bool
     {
         pkgDepCache::ActionGroup group(*m_cache);
         for (PkgList::const_iterator it = install.begin(); it != install.end(); ++it) {
-            if (m_cancel) {
+            if (cancelled()) {
                 break;
             }
 
@@ -2401,7 +2521,7 @@ bool AptIntf::runTransaction(const PkgList &install, const PkgList &remove, bool
         }
 
         for (PkgList::const_iterator it = remove.begin(); it != remove.end(); ++it) {
-            if (m_cancel) {
+            if (cancelled()) {
                 break;
             }
 
@@ -2560,7 +2680,7 @@ bool AptIntf::installPackages(PkBitfield flags, bool autoremove)
 
     // Download and check if we can continue
     if (fetcher.Run() != pkgAcquire::Continue
-            && m_cancel == false) {
+            && !cancelled()) {
         // We failed and we did not cancel
         show_errors(m_job, PK_ERROR_ENUM_PACKAGE_DOWNLOAD_FAILED);
         return false;
@@ -2577,7 +2697,7 @@ bool AptIntf::installPackages(PkBitfield flags, bool autoremove)
     }
 
     // Check if the user canceled
-    if (m_cancel) {
+    if (cancelled()) {
         return true;
     }
 
@@ -2641,6 +2761,17 @@ bool AptIntf::installPackages(PkBitfield flags, bool autoremove)
         }
         g_free(locale);
 
+        // The maintainer scripts get the proxies of this job
+        gchar *proxy;
+        if (proxy = pk_backend_job_get_proxy_http(m_job)) {
+            setenv("http_proxy", proxy, 1);
+        }
+        g_free(proxy);
+        if (proxy = pk_backend_job_get_proxy_ftp(m_job)) {
+            setenv("ftp_proxy", proxy, 1);
+        }
+        g_free(proxy);
+
         // Pass the write end of the pipe to the install function
         res = PM->DoInstallPostFork(readFromChildFD[1]);
 
@@ -2661,6 +2792,7 @@ bool AptIntf::installPackages(PkBitfield flags, bool autoremove)
     // init the timer
     m_lastTermAction = time(NULL);
     m_startCounting = false;
+    m_statusBuffer.clear();
 
     // Check if the child died
     int ret;
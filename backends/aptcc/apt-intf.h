@@ -48,6 +48,20 @@ public:
     ~AptIntf();
 
     bool init();
+
+    /**
+     * Remembers the proxies set in apt.conf, must be called
+     * once before any job starts
+     */
+    static void initProxies();
+
+    /**
+     * Waits until no other job that changes the system is running,
+     * the lock is held until this object is destroyed
+     * @returns false if the job was cancelled while waiting
+     */
+    bool lockWriter();
+
     void cancel();
     bool cancelled() const;
 
@@ -106,10 +120,10 @@ public:
                     bool recursive);
 
     /**
-     *  Get package requires
+     *  Get the packages requiring any of pkgs
      */
     void getRequires(PkgList &output,
-                     const pkgCache::VerIterator &ver,
+                     const PkgList &pkgs,
                      bool recursive);
 
     /**
@@ -246,12 +260,20 @@ public:
     AptCacheFile* aptCacheFile() const;
 
 private:
+    bool canUseSharedCache(PkRoleEnum role);
+
+    /**
+     * Sets the proxies of this job in _config for the fetchers, the
+     * other jobs can't download until this object is destroyed
+     */
+    void lockAcquire();
     bool checkTrusted(pkgAcquire &fetcher, PkBitfield flags);
     bool packageIsSupported(const pkgCache::VerIterator &verIter, string component);
     bool isApplication(const pkgCache::VerIterator &verIter);
 
     /**
-     *  interprets dpkg status fd
+     *  interprets dpkg status fd, reading whatever is available
+     *  and keeping an incomplete last line for the next call
      */
     void updateInterface(int readFd, int writeFd);
     PkgList checkChangedPackages(bool emitChanged);
@@ -259,7 +281,9 @@ private:
 
     AptCacheFile *m_cache;
     PkBackendJob  *m_job;
-    bool       m_cancel;
+    gint       m_cancel;
+    bool       m_writerLocked;
+    bool       m_acquireLocked;
     struct stat m_restartStat;
 
     bool m_isMultiArch;
@@ -270,6 +294,7 @@ private:
     string     m_lastPackage;
     uint       m_lastSubProgress;
     bool       m_startCounting;
+    string     m_statusBuffer;
 
     // when the internal terminal timesout after no activity
     int m_terminalTimeout;
@@ -25,6 +25,7 @@
 #include <glib/gstdio.h>
 
 #include <fstream>
+#include <cstring>
 
 PkGroupEnum get_enum_group(string group)
 {
@@ -435,7 +436,8 @@ gchar* utilBuildPackageId(const pkgCache::VerIterator &ver)
 
 const char *utf8(const char *str)
 {
-    static char *_str = NULL;
+    // One buffer per thread as jobs run in parallel
+    static GPrivate _str = G_PRIVATE_INIT(g_free);
     if (str == NULL) {
         return NULL;
     }
@@ -444,8 +446,52 @@ const char *utf8(const char *str)
         return str;
     }
 
-    g_free(_str);
-    _str = NULL;
-    _str = g_locale_to_utf8(str, -1, NULL, NULL, NULL);
-    return _str;
+    g_private_replace(&_str, g_locale_to_utf8(str, -1, NULL, NULL, NULL));
+    return static_cast<const char*>(g_private_get(&_str));
+}
+
+pkgCache::VerIterator findVer(pkgCacheFile &cache, const pkgCache::PkgIterator &pkg)
+{
+    // if the package is installed return the current version
+    if (!pkg.CurrentVer().end()) {
+        return pkg.CurrentVer();
+    }
+
+    // Else get the candidate version iterator
+    const pkgCache::VerIterator &candidateVer = cache[pkg].CandidateVerIter(cache);
+    if (!candidateVer.end()) {
+        return candidateVer;
+    }
+
+    // return the version list as a last resource
+    return pkg.VersionList();
+}
+
+pkgCache::DescIterator findDescription(const pkgCache::VerIterator &ver, const std::string &locale)
+{
+    // "de_DE.UTF-8@euro" is looked up as "de_DE" then "de", like apt does
+    std::string language = locale.substr(0, locale.find_first_of(".@"));
+    std::string base = language.substr(0, language.find('_'));
+
+    pkgCache::DescIterator untranslated;
+    pkgCache::DescIterator fallback;
+    for (pkgCache::DescIterator d = ver.DescriptionList(); !d.end(); ++d) {
+        const char *code = d.LanguageCode();
+        if (!language.empty() && language.compare(code) == 0) {
+            return d;
+        }
+        if (fallback.end() && !base.empty() && base.compare(code) == 0) {
+            fallback = d;
+        } else if (untranslated.end() && (code[0] == '\0' || strcmp(code, "en") == 0)) {
+            untranslated = d;
+        }
+    }
+
+    if (!fallback.end()) {
+        return fallback;
+    }
+    if (!untranslated.end()) {
+        return untranslated;
+    }
+    return ver.DescriptionList();
 }
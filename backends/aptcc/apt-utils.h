@@ -90,4 +90,18 @@ gchar* utilBuildPackageId(const pkgCache::VerIterator &ver);
   */
 const char *utf8(const char *str);
 
+/**
+  * Same as AptCacheFile::findVer() for any cache, used by
+  * the indexes that are built on the shared cache
+  */
+pkgCache::VerIterator findVer(pkgCacheFile &cache, const pkgCache::PkgIterator &pkg);
+
+/**
+  * Returns the description of ver in the language of locale (as in
+  * "de_DE.UTF-8"), or the untranslated one. Unlike TranslatedDescription()
+  * this doesn't depend on the process locale, which jobs running in
+  * parallel can't change
+  */
+pkgCache::DescIterator findDescription(const pkgCache::VerIterator &ver, const std::string &locale);
+
 #endif
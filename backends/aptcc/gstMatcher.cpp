@@ -48,9 +48,8 @@ GstMatcher::GstMatcher(gchar **values)
             Match values;
             string version, type, data, opt;
 
-            // Appends the version "0.10"
-            version = "\nGstreamer-Version: ";
-            version.append(string(value, matches[1].rm_so, matches[1].rm_eo - matches[1].rm_so));
+            // The version "0.10"
+            version = string(value, matches[1].rm_so, matches[1].rm_eo - matches[1].rm_so);
 
             // type (encode|decoder...)
             type = string(value, matches[2].rm_so, matches[2].rm_eo - matches[2].rm_so);
@@ -65,15 +64,15 @@ GstMatcher::GstMatcher(gchar **values)
             }
 
             if (type.compare("encoder") == 0) {
-                type = "Gstreamer-Encoders: ";
+                type = "Gstreamer-Encoders";
             } else if (type.compare("decoder") == 0) {
-                type = "Gstreamer-Decoders: ";
+                type = "Gstreamer-Decoders";
             } else if (type.compare("urisource") == 0) {
-                type = "Gstreamer-Uri-Sources: ";
+                type = "Gstreamer-Uri-Sources";
             } else if (type.compare("urisink") == 0) {
-                type = "Gstreamer-Uri-Sinks: ";
+                type = "Gstreamer-Uri-Sinks";
             } else if (type.compare("element") == 0) {
-                type = "Gstreamer-Elements: ";
+                type = "Gstreamer-Elements";
             }
             //             cout << version << endl;
             //             cout << type << endl;
@@ -109,43 +108,31 @@ GstMatcher::GstMatcher(gchar **values)
 
 GstMatcher::~GstMatcher()
 {
-    gst_deinit();
+    // No gst_deinit() here, other jobs might still be using
+    // GStreamer and it can't be initialized again afterwards
 
     for (vector<Match>::iterator i = m_matches.begin(); i != m_matches.end(); ++i) {
         gst_caps_unref(static_cast<GstCaps*>(i->caps));
     }
 }
 
-bool GstMatcher::matches(string record)
+bool GstMatcher::matches(const Match &match, const string &caps) const
 {
-    for (vector<Match>::iterator i = m_matches.begin(); i != m_matches.end(); ++i) {
-        // Tries to find "Gstreamer-version: xxx"
-        if (record.find(i->version) != string::npos) {
-            size_t found;
-            found = record.find(i->type);
-            // Tries to find the type "Gstreamer-Uri-Sinks: "
-            if (found != string::npos) {
-                found += i->type.size(); // skips the "Gstreamer-Uri-Sinks: " string
-                size_t endOfLine;
-                endOfLine = record.find('\n', found);
-
-                GstCaps *caps;
-                caps = gst_caps_from_string(record.substr(found, endOfLine - found).c_str());
-                if (caps == NULL) {
-                    continue;
-                }
-
-                // if the record is capable of intersect them we found the package
-                bool provides = gst_caps_can_intersect(static_cast<GstCaps*>(i->caps), caps);
-                gst_caps_unref(caps);
-
-                if (provides) {
-                    return true;
-                }
-            }
-        }
+    GstCaps *recordCaps = gst_caps_from_string(caps.c_str());
+    if (recordCaps == NULL) {
+        return false;
     }
-    return false;
+
+    // if the record is capable of intersect them we found the package
+    bool provides = gst_caps_can_intersect(static_cast<GstCaps*>(match.caps), recordCaps);
+    gst_caps_unref(recordCaps);
+
+    return provides;
+}
+
+const vector<Match>& GstMatcher::matchList() const
+{
+    return m_matches;
 }
 
 bool GstMatcher::hasMatches() const
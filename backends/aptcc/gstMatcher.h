@@ -29,7 +29,9 @@
 using namespace std;
 
 typedef struct {
+    // the GStreamer version, like "1.0"
     string   version;
+    // the record field, like "Gstreamer-Decoders"
     string   type;
     string   data;
     string   opt;
@@ -42,7 +44,12 @@ public:
     GstMatcher(gchar **values);
     ~GstMatcher();
 
-    bool matches(string record);
+    /**
+     * Returns true if the caps of a record field
+     * named like match.type provide what match asks for
+     */
+    bool matches(const Match &match, const string &caps) const;
+    const vector<Match>& matchList() const;
     bool hasMatches() const;
 
 private:
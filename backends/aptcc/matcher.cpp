@@ -22,6 +22,7 @@
 
 #include "matcher.h"
 #include <stdio.h>
+#include <string.h>
 #include <iostream>
 
 Matcher::Matcher(const string &matchers) :
@@ -36,58 +37,103 @@ Matcher::Matcher(const string &matchers) :
 
 Matcher::~Matcher()
 {
-    for (vector<regex_t>::iterator i=m_matches.begin();
+    for (vector<Pattern>::iterator i=m_matches.begin();
          i != m_matches.end(); ++i) {
-        regfree(&*i);
+        if (i->type == PatternRegex) {
+            regfree(&i->regex);
+        }
     }
 }
 
-bool do_compile(const string &_pattern,
-                regex_t &pattern,
-                int cflags)
+static char ascii_tolower(char c)
 {
-    return !regcomp(&pattern, _pattern.c_str(), cflags);
+    return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+// Returns true if the pattern means the same as a plain string,
+// non ASCII text is left to the regex engine to fold the case
+static bool is_literal(const string &pattern, string::size_type from)
+{
+    for (string::size_type i = from; i < pattern.size(); ++i) {
+        const unsigned char c = pattern[i];
+        if (c >= 0x80 || strchr(".[]()*+?{}|^$\\", c) != NULL) {
+            return false;
+        }
+    }
+    return true;
 }
 
-bool string_matches(const char *s, regex_t &pattern_nogroup)
+bool Matcher::matches(const string &s) const
 {
-    return !regexec(&pattern_nogroup, s, 0, NULL, 0);
+    // This is called for every package name from several threads,
+    // so avoid allocating for the short strings
+    char buffer[256];
+    string copy;
+    char *lowercase = buffer;
+    if (s.size() >= sizeof(buffer)) {
+        copy.resize(s.size() + 1);
+        lowercase = &copy[0];
+    }
+
+    for (string::size_type i = 0; i < s.size(); ++i) {
+        lowercase[i] = ascii_tolower(s[i]);
+    }
+    lowercase[s.size()] = '\0';
+
+    return matchesLowercase(lowercase, s.size());
 }
 
-bool Matcher::matches(const string &s)
+bool Matcher::matchesLowercase(const char *s, size_t length) const
 {
-    int matchesCount = 0;
-    for (vector<regex_t>::iterator i=m_matches.begin();
+    // All the patterns must match, the cheap ones are tried first
+    for (vector<Pattern>::const_iterator i=m_matches.begin();
          i != m_matches.end(); ++i) {
-        if (string_matches(s.c_str(), *i)) {
-            matchesCount++;
+        if (!patternMatches(*i, s, length)) {
+            return false;
         }
     }
-    return m_matches.size() == matchesCount;
+    return true;
+}
+
+bool Matcher::patternMatches(const Pattern &pattern, const char *s, size_t length) const
+{
+    switch (pattern.type) {
+    case PatternLiteral:
+        return memmem(s, length, pattern.text.data(), pattern.text.size()) != NULL;
+    case PatternPrefix:
+        return length >= pattern.text.size() &&
+                memcmp(s, pattern.text.data(), pattern.text.size()) == 0;
+    default:
+        return !regexec(&pattern.regex, s, 0, NULL, 0);
+    }
 }
 
 // This matcher is to be used for files
 // pass a map so it can remember which patter was alread used
 bool Matcher::matchesFile(const string &s, map<int, bool> &matchers_used)
 {
-    int matchesCount = 0;
-    for (vector<regex_t>::iterator i = m_matches.begin();
-         i != m_matches.end(); ++i) {
-        for (int i = 0; i < m_matches.size(); ++i) {
-            bool not_used = true;
-            if (matchers_used.find(i) != matchers_used.end()) {
-                not_used = true;
-            }
+    string lowercase(s);
+    for (string::size_type i = 0; i < lowercase.size(); ++i) {
+        lowercase[i] = ascii_tolower(lowercase[i]);
+    }
 
-            if (not_used && string_matches(s.c_str(), m_matches.at(i))) {
-                matchers_used[i] = true;
-            }
+    for (int i = 0; i < m_matches.size(); ++i) {
+        if (matchers_used.find(i) == matchers_used.end() &&
+                patternMatches(m_matches.at(i), lowercase.c_str(), lowercase.size())) {
+            matchers_used[i] = true;
         }
     }
 
     return m_matches.size() == matchers_used.size();
 }
 
+bool do_compile(const string &_pattern,
+                regex_t &pattern,
+                int cflags)
+{
+    return !regcomp(&pattern, _pattern.c_str(), cflags);
+}
+
 bool Matcher::parse_pattern(string::const_iterator &start,
                             const std::string::const_iterator &end)
 {
@@ -104,19 +150,40 @@ bool Matcher::parse_pattern(string::const_iterator &start,
         string subString = parse_substr(start, end);
 
         if (subString.empty()) {
+            // Skip a metacharacter we don't handle, like '(' or '!'
+            if (start != end && *start != '|' && *start != ')') {
+                ++start;
+            }
             continue;
         }
 
-        regex_t pattern_nogroup;
-        if (do_compile(subString, pattern_nogroup, REG_ICASE|REG_EXTENDED|REG_NOSUB)) {
-            m_matches.push_back(pattern_nogroup);
+        // Plain strings and prefixes don't need the regex engine
+        Pattern pattern;
+        memset(&pattern.regex, 0, sizeof(pattern.regex));
+        if (is_literal(subString, 0)) {
+            pattern.type = PatternLiteral;
+            pattern.text = subString;
+        } else if (subString[0] == '^' && subString.size() > 1 && is_literal(subString, 1)) {
+            pattern.type = PatternPrefix;
+            pattern.text = subString.substr(1);
+        } else if (do_compile(subString, pattern.regex, REG_ICASE|REG_EXTENDED|REG_NOSUB)) {
+            pattern.type = PatternRegex;
         } else {
-            regfree(&pattern_nogroup);
             m_error = string("Regex compilation error");
             m_hasError = true;
             return false;
         }
 
+        for (string::size_type i = 0; i < pattern.text.size(); ++i) {
+            pattern.text[i] = ascii_tolower(pattern.text[i]);
+        }
+
+        if (pattern.type == PatternRegex) {
+            m_matches.push_back(pattern);
+        } else {
+            m_matches.insert(m_matches.begin(), pattern);
+        }
+
         // 		regex_t pattern_group;
         // 		if (do_compile(subString, pattern_group, REG_ICASE|REG_EXTENDED)) {
         // 			m_matches.push_back(pattern_group);
@@ -36,11 +36,34 @@ public:
     Matcher(const string &matchers);
     ~Matcher();
 
-    bool matches(const string &s);
+    bool matches(const string &s) const;
+
+    /**
+     * Like matches() but the ASCII letters of s must already be in
+     * lowercase, as they are in the DescriptionCorpus, so no copy is made
+     */
+    bool matchesLowercase(const char *s, size_t length) const;
+
     bool matchesFile(const string &s, map<int, bool> &matchers_used);
     bool hasError() const;
 
 private:
+    enum PatternType {
+        PatternLiteral,
+        PatternPrefix,
+        PatternRegex
+    };
+
+    struct Pattern {
+        PatternType type;
+        // lowercase, without the ^ of prefixes
+        string text;
+        // only compiled for PatternRegex
+        regex_t regex;
+    };
+
+    bool patternMatches(const Pattern &pattern, const char *s, size_t length) const;
+
     bool m_hasError;
     string m_error;
     bool parse_pattern(string::const_iterator &start,
@@ -49,7 +72,7 @@ private:
                         const string::const_iterator &end);
     string parse_literal_string_tail(string::const_iterator &start,
                                      const string::const_iterator end);
-    vector<regex_t> m_matches;
+    vector<Pattern> m_matches;
 };
 
 #endif
@@ -30,6 +30,7 @@
 
 #include "apt-intf.h"
 #include "AptCacheFile.h"
+#include "AptSharedCache.h"
 #include "apt-messages.h"
 #include "acqpkitstatus.h"
 #include "apt-sourceslist.h"
@@ -59,8 +60,9 @@ const gchar* pk_backend_get_author(PkBackend *backend)
 gboolean
 pk_backend_supports_parallelization (PkBackend *backend)
 {
-	// we need to set this to TRUE as soon as the parallelization work is completed!
-	return FALSE;
+	// Read-only jobs share a cache snapshot, the ones changing
+	// the system take the writer lock in AptIntf::init()
+	return TRUE;
 }
 
 /**
@@ -89,6 +91,9 @@ void pk_backend_initialize(GKeyFile *conf, PkBackend *backend)
         g_debug("ERROR initializing backend system");
     }
 
+    // The jobs set their own proxies, keep the configured ones
+    AptIntf::initProxies();
+
     spawn = pk_backend_spawn_new(conf);
 //     pk_backend_spawn_set_job(spawn, backend);
     pk_backend_spawn_set_name(spawn, "aptcc");
@@ -100,6 +105,9 @@ void pk_backend_initialize(GKeyFile *conf, PkBackend *backend)
 void pk_backend_destroy(PkBackend *backend)
 {
     g_debug("APTcc being destroyed");
+
+    // Release the shared cache, jobs are all gone by now
+    AptSharedCache::invalidate();
 }
 
 /**
@@ -235,6 +243,7 @@ static void backend_depends_on_or_requires_thread(PkBackendJob *job, GVariant *p
 
     pk_backend_job_set_status(job, PK_STATUS_ENUM_QUERY);
     PkgList output;
+    PkgList pkgs;
     for (uint i = 0; i < g_strv_length(package_ids); ++i) {
         if (apt->cancelled()) {
             break;
@@ -262,10 +271,15 @@ static void backend_depends_on_or_requires_thread(PkBackendJob *job, GVariant *p
         if (role == PK_ROLE_ENUM_DEPENDS_ON) {
             apt->getDepends(output, ver, recursive);
         } else {
-            apt->getRequires(output, ver, recursive);
+            pkgs.push_back(ver);
         }
     }
 
+    // Walk the reverse dependencies of all packages at once
+    if (role == PK_ROLE_ENUM_REQUIRED_BY) {
+        apt->getRequires(output, pkgs, recursive);
+    }
+
     // It's faster to emmit the packages here than in the matching part
     apt->emitPackages(output, filters);
 
@@ -1048,6 +1062,12 @@ static void backend_repo_manager_thread(PkBackendJob *job, GVariant *params, gpo
                        &enabled);
     }
 
+    // Don't edit the sources while another job changes the system
+    if (role != PK_ROLE_ENUM_GET_REPO_LIST && !apt->lockWriter()) {
+        apt->emitFinished();
+        return;
+    }
+
     SourcesList _lst;
     if (_lst.ReadSources() == false) {
         _error->
@@ -24,10 +24,10 @@
 
 #include "config.h"
 
+#include <deque>
 #include <iterator>
 #include <list>
 #include <map>
-#include <pthread.h>
 #include <set>
 #include <sstream>
 #include <stdio.h>
@@ -48,6 +48,8 @@
 #include <packagekit-glib2/pk-enum.h>
 #include <pk-backend-spawn.h>
 
+#include "zypp-cache-builder.h"
+
 #include <zypp/Digest.h>
 #include <zypp/KeyRing.h>
 #include <zypp/Package.h>
@@ -69,6 +71,7 @@
 #include <zypp/Resolvable.h>
 #include <zypp/SrcPackage.h>
 #include <zypp/TmpPath.h>
+#include <zypp/ZConfig.h>
 #include <zypp/ZYpp.h>
 #include <zypp/ZYppCallbacks.h>
 #include <zypp/ZYppFactory.h>
@@ -92,6 +95,9 @@
 #include <zypp/target/rpm/librpmDb.h>
 #include <zypp/ui/Selectable.h>
 
+#include <rpm/header.h>
+#include <rpm/rpmtd.h>
+
 using namespace std;
 using namespace zypp;
 using zypp::filesystem::PathInfo;
@@ -99,6 +105,9 @@ using zypp::filesystem::PathInfo;
 #undef ZYPP_BASE_LOGGER_LOGGROUP
 #define ZYPP_BASE_LOGGER_LOGGROUP "packagekit"
 
+/* how long read-only jobs share the pool before one checks it for changes */
+#define ZYPP_SHARED_POOL_TIMEOUT	30 /* s */
+
 typedef enum {
         INSTALL,
         REMOVE,
@@ -106,11 +115,44 @@ typedef enum {
 } PerformType;
 
 
+/// \class ZyppJob
+/// \brief Gives a job access to zypp for its lifetime.
+///
+/// Jobs changing the pool or the system get zypp exclusively. Read-only
+/// jobs share it right away when no such job is running or waiting, the
+/// pool was checked for changes on disk less than ZYPP_SHARED_POOL_TIMEOUT
+/// seconds ago and the rpm database was not changed since. Otherwise they
+/// get it exclusively too, reload what changed and call share() to let the
+/// others in. Nothing changes the pool while it is shared, so all the
+/// shared jobs read the same one.
+///
+/// A shared job must not load or refresh anything, and has to hold a
+/// ZyppPoolLock while it calls into libsolv.
 class ZyppJob {
  public:
-	ZyppJob(PkBackendJob *job);
+	ZyppJob(PkBackendJob *job, gboolean read_only = FALSE);
 	~ZyppJob();
 	zypp::ZYpp::Ptr get_zypp();
+	void share();
+	gboolean is_shared() const { return _shared; }
+ private:
+	PkBackendJob *_job;
+	gboolean _read_only;
+	gboolean _shared;
+};
+
+/// \class ZyppPoolLock
+/// \brief Serializes the libsolv calls of the jobs sharing zypp.
+///
+/// libsolv is not thread safe even for reading: queries and capabilities
+/// intern their strings in the pool, and repodata is paged in lazily.
+/// The shared jobs don't get their own copy of the pool, they take turns
+/// on it instead, holding this lock for one query or one package at a
+/// time so their queries and their output interleave.
+class ZyppPoolLock {
+ public:
+	ZyppPoolLock();
+	~ZyppPoolLock();
 };
 
 enum PkgSearchType {
@@ -417,7 +459,7 @@ struct ProgressReportReceiver : public zypp::callback::ReceiveReport<zypp::Progr
         }
 };
 
-// These last two are called -only- from zypp_refresh_meta_and_cache
+// These last two are called -only- from zypp_refresh_meta
 // *if this is not true* - we will get un-caught Abort exceptions.
 
 struct KeyRingReportReceiver : public zypp::callback::ReceiveReport<zypp::KeyRingReport>, ZyppBackendReceiver
@@ -527,35 +569,107 @@ class PkBackendZYppPrivate {
 	EventDirector eventDirector;
 	PkBackendJob *currentJob;
 	
-	pthread_mutex_t zypp_mutex;
+	// the jobs sharing zypp, or if one has it exclusively
+	GMutex zypp_mutex;
+	GCond zypp_cond;
+	guint readers;
+	guint writers_waiting;
+	gboolean writer;
+	// until when read-only jobs may share the pool without checking it
+	gint64 pool_shared_until;
+	// the rpm database the shared pool was loaded from
+	Target_Ptr pool_target;
+	Date pool_rpmdb;
+
+	// taken by the shared jobs around their libsolv calls
+	GRecMutex pool_mutex;
+
+	// how many repository caches are built at the same time
+	gint max_parallel_refreshes;
 };
 
 }; // namespace ZyppBackend
 
 using namespace ZyppBackend;
 
-ZyppJob::ZyppJob(PkBackendJob *job)
+/**
+ * Packages installed by others since the pool was shared would be missed,
+ * so don't let more jobs share it once the rpm database changed.
+ */
+static gboolean
+zypp_shared_pool_is_current ()
+{
+	if (priv->pool_target == NULL ||
+	    g_get_monotonic_time () >= priv->pool_shared_until)
+		return FALSE;
+	return priv->pool_target->rpmDb ().timestamp () == priv->pool_rpmdb;
+}
+
+ZyppJob::ZyppJob(PkBackendJob *job, gboolean read_only)
+	: _job(job), _read_only(read_only), _shared(FALSE)
 {
 	MIL << "locking zypp" << std::endl;
-	pthread_mutex_lock(&priv->zypp_mutex);
+	g_mutex_lock(&priv->zypp_mutex);
+	if (!read_only)
+		priv->writers_waiting++;
+	for (;;) {
+		// join the other readers on a pool known to be current
+		if (read_only && !priv->writer && priv->writers_waiting == 0 &&
+		    zypp_shared_pool_is_current ()) {
+			priv->readers++;
+			_shared = TRUE;
+			g_mutex_unlock(&priv->zypp_mutex);
+			MIL << "sharing zypp" << std::endl;
+			return;
+		}
+		if (!priv->writer && priv->readers == 0)
+			break;
+		g_cond_wait(&priv->zypp_cond, &priv->zypp_mutex);
+	}
+	if (!read_only)
+		priv->writers_waiting--;
+	priv->writer = TRUE;
+	// the pool has to be checked again before it can be shared
+	priv->pool_shared_until = 0;
+	priv->pool_target = NULL;
+	g_mutex_unlock(&priv->zypp_mutex);
 
 	if (priv->currentJob) {
 		MIL << "currentjob is already defined - highly impossible" << endl;
 	}
 	
-	pk_backend_job_set_locked(job, true);
+	// read-only jobs don't keep others from running
+	if (!read_only)
+		pk_backend_job_set_locked(job, true);
 	priv->currentJob = job;
 	priv->eventDirector.setJob(job);
 }
 
 ZyppJob::~ZyppJob()
 {
-	if (priv->currentJob)
-		pk_backend_job_set_locked(priv->currentJob, false);
-	priv->currentJob = 0;
-	priv->eventDirector.setJob(0);
+	g_mutex_lock(&priv->zypp_mutex);
+	if (_shared) {
+		priv->readers--;
+	} else {
+		if (priv->currentJob && !_read_only)
+			pk_backend_job_set_locked(priv->currentJob, false);
+		priv->currentJob = 0;
+		priv->eventDirector.setJob(0);
+		priv->writer = FALSE;
+	}
+	g_cond_broadcast(&priv->zypp_cond);
 	MIL << "unlocking zypp" << std::endl;
-	pthread_mutex_unlock(&priv->zypp_mutex);
+	g_mutex_unlock(&priv->zypp_mutex);
+}
+
+ZyppPoolLock::ZyppPoolLock()
+{
+	g_rec_mutex_lock(&priv->pool_mutex);
+}
+
+ZyppPoolLock::~ZyppPoolLock()
+{
+	g_rec_mutex_unlock(&priv->pool_mutex);
 }
 
 /**
@@ -579,10 +693,10 @@ ZyppJob::get_zypp()
 			initialized = TRUE;
 		}
 	} catch (const ZYppFactoryException &ex) {
-		pk_backend_job_error_code (priv->currentJob, PK_ERROR_ENUM_FAILED_INITIALIZATION, ex.asUserString().c_str() );
+		pk_backend_job_error_code (_job, PK_ERROR_ENUM_FAILED_INITIALIZATION, ex.asUserString().c_str() );
 		return NULL;
 	} catch (const Exception &ex) {
-		pk_backend_job_error_code (priv->currentJob, PK_ERROR_ENUM_INTERNAL_ERROR, ex.asUserString().c_str() );
+		pk_backend_job_error_code (_job, PK_ERROR_ENUM_INTERNAL_ERROR, ex.asUserString().c_str() );
 		return NULL;
 	}
 
@@ -683,40 +797,66 @@ zypp_is_valid_repo (PkBackendJob *job, RepoInfo repo)
 	return TRUE;
 }
 
+/**
+ * The repositories zypp_build_pool() loaded into the pool, mapped to
+ * the checksum of the solv cache they were loaded from, and the rpmdb
+ * timestamp the system repository was loaded at.
+ */
+static map<string, string> _pool_repos;
+static Date _pool_rpmdb;
+
+/**
+ * (Re)load a repository from its solv cache and remember its checksum
+ */
+static void
+zypp_pool_load_repo (RepoManager &manager, const RepoInfo &repo)
+{
+	sat::Pool pool = sat::Pool::instance ();
+
+	if (pool.reposFind (repo.alias ()) != Repository::noRepository)
+		pool.reposErase (repo.alias ());
+	manager.loadFromCache (repo);
+	_pool_repos[repo.alias ()] = manager.cacheStatus (repo).checksum ();
+}
+
+static void zypp_prepare_pool ();
+
 /**
  * Build and return a ResPool that contains all local resolvables
  * and ones found in the enabled repositories.
+ *
+ * Only what changed since the last call is loaded again: repositories
+ * whose solv cache has a different checksum, and the system repository
+ * when the rpm database was modified. Once loaded, the system repository
+ * stays in the pool even if include_local is not set.
  */
 ResPool
 zypp_build_pool (ZYpp::Ptr zypp, gboolean include_local)
 {
-	static gboolean repos_loaded = FALSE;
+	sat::Pool pool = sat::Pool::instance ();
 
-	// the target is loaded or unloaded on request
+	// the target is loaded on request, and reloaded when the rpmdb changed
 	if (include_local) {
-		// FIXME have to wait for fix in zypp (repeated loading of target)
-		if (sat::Pool::instance().reposFind( sat::Pool::systemRepoAlias() ).solvablesEmpty ())
+		Target_Ptr target = zypp->target ();
+		Date rpmdb = target->rpmDb ().timestamp ();
+		Repository system = pool.reposFind (sat::Pool::systemRepoAlias ());
+
+		if (system == Repository::noRepository || system.solvablesEmpty () || rpmdb != _pool_rpmdb)
 		{
+			if (system != Repository::noRepository)
+				system.eraseFromPool ();
+
 			// Add local resolvables
-			Target_Ptr target = zypp->target ();
 			target->load ();
-		}
-	} else {
-		if (!sat::Pool::instance().reposFind( sat::Pool::systemRepoAlias() ).solvablesEmpty ())
-		{
-			// Remove local resolvables
-			Repository repository = sat::Pool::instance ().reposFind (sat::Pool::systemRepoAlias());
-			repository.eraseFromPool ();
+			_pool_rpmdb = rpmdb;
 		}
 	}
 
-	// we only load repositories once.
-	if (repos_loaded)
-		return zypp->pool();
-
-	// Add resolvables from enabled repos
+	// Add, reload or drop resolvables of the repos that changed
 	RepoManager manager;
 	try {
+		set<string> enabled;
+
 		for (RepoManager::RepoConstIterator it = manager.repoBegin(); it != manager.repoEnd(); ++it) {
 			RepoInfo repo (*it);
 
@@ -728,12 +868,30 @@ zypp_build_pool (ZYpp::Ptr zypp, gboolean include_local)
 				g_warning ("%s is not cached! Do a refresh", repo.alias ().c_str ());
 				continue;
 			}
-			//FIXME see above, skip already cached repos
-			if (sat::Pool::instance().reposFind( repo.alias ()) == Repository::noRepository)
-				manager.loadFromCache (repo);
+			enabled.insert (repo.alias ());
 
+			map<string, string>::const_iterator loaded = _pool_repos.find (repo.alias ());
+			if (loaded != _pool_repos.end () &&
+			    loaded->second == manager.cacheStatus (repo).checksum () &&
+			    pool.reposFind (repo.alias ()) != Repository::noRepository)
+				continue;
+
+			MIL << "loading " << repo.alias () << " from cache" << endl;
+			zypp_pool_load_repo (manager, repo);
+		}
+
+		// drop the repos that were removed, disabled or lost their cache
+		for (map<string, string>::iterator it = _pool_repos.begin (); it != _pool_repos.end (); ) {
+			if (enabled.find (it->first) != enabled.end ()) {
+				++it;
+				continue;
+			}
+
+			MIL << "dropping " << it->first << " from the pool" << endl;
+			if (pool.reposFind (it->first) != Repository::noRepository)
+				pool.reposErase (it->first);
+			_pool_repos.erase (it++);
 		}
-		repos_loaded = true;
 	} catch (const repo::RepoNoAliasException &ex) {
 		g_error ("Can't figure an alias to look in cache");
 	} catch (const repo::RepoNotCachedException &ex) {
@@ -742,6 +900,7 @@ zypp_build_pool (ZYpp::Ptr zypp, gboolean include_local)
 		g_error ("TODO: Handle exceptions: %s", ex.asUserString ().c_str ());
 	}
 
+	zypp_prepare_pool ();
 	return zypp->pool ();
 }
 
@@ -770,12 +929,11 @@ warn_outdated_repos(PkBackendJob *job, const ResPool & pool)
 }
 
 /**
-  * Return the rpmHeader of a package
+  * Return the rpmHeader of a package, using an open rpm database iterator
   */
 target::rpm::RpmHeader::constPtr
-zypp_get_rpmHeader (const string &name, Edition edition)
+zypp_get_rpmHeader (target::rpm::librpmDb::db_const_iterator &it, const string &name, Edition edition)
 {
-	target::rpm::librpmDb::db_const_iterator it;
 	target::rpm::RpmHeader::constPtr result = new target::rpm::RpmHeader ();
 
 	for (it.findPackage (name, edition); *it; ++it) {
@@ -894,6 +1052,45 @@ zypp_get_packages_by_file (ZYpp::Ptr zypp,
 	}
 }
 
+/**
+ * The package_ids of all the solvables in the pool, mapped to their
+ * solvable id, and the serial of the pool the index was built for.
+ */
+static GHashTable *_package_id_index = NULL;
+static unsigned _package_id_index_serial = 0;
+
+/**
+ * (Re)build the package_id index if the pool changed since it was built
+ */
+static GHashTable *
+zypp_get_package_id_index ()
+{
+	unsigned serial = sat::Pool::instance ().serial ().serial ();
+
+	if (_package_id_index != NULL && _package_id_index_serial == serial)
+		return _package_id_index;
+
+	if (_package_id_index != NULL)
+		g_hash_table_unref (_package_id_index);
+	_package_id_index = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	_package_id_index_serial = serial;
+
+	ResPool pool = ResPool::instance ();
+	for (ResPool::const_iterator it = pool.begin (); it != pool.end (); ++it) {
+		sat::Solvable solvable = it->satSolvable ();
+		gchar *package_id = zypp_build_package_id_from_resolvable (solvable);
+
+		// keep the first one, like a lookup by name would
+		if (g_hash_table_lookup (_package_id_index, package_id) == NULL)
+			g_hash_table_insert (_package_id_index, package_id, GUINT_TO_POINTER (solvable.id ()));
+		else
+			g_free (package_id);
+	}
+	MIL << "indexed " << g_hash_table_size (_package_id_index) << " package ids" << endl;
+
+	return _package_id_index;
+}
+
 /**
  * Returns the Resolvable for the specified package_id.
  * e.g. gnome-packagekit;3.6.1-132.1;x86_64;G:F
@@ -909,58 +1106,73 @@ zypp_get_package_by_id (const gchar *package_id)
 
 	gchar **id_parts = pk_package_id_split(package_id);
 	const gchar *arch = id_parts[PK_PACKAGE_ID_ARCH];
-	if (!arch)
+	if (!arch || arch[0] == '\0')
 		arch = "noarch";
-	bool want_source = !g_strcmp0 (arch, "source");
-	
-	sat::Solvable package;
+	const gchar *data = id_parts[PK_PACKAGE_ID_DATA];
+	if (!strncmp(data, "installed", 9))
+		data = "installed";
 
-	ResPool pool = ResPool::instance();
+	// the index uses the package_ids we emit, so normalize this one
+	gchar *key = pk_package_id_build (id_parts[PK_PACKAGE_ID_NAME],
+					  id_parts[PK_PACKAGE_ID_VERSION],
+					  arch, data);
+	gpointer id = g_hash_table_lookup (zypp_get_package_id_index (), key);
 
-	// Iterate over the resolvables and mark the one we want to check its dependencies
-	for (ResPool::byName_iterator it = pool.byNameBegin (id_parts[PK_PACKAGE_ID_NAME]);
-	     it != pool.byNameEnd (id_parts[PK_PACKAGE_ID_NAME]); ++it) {
-		
-		sat::Solvable pkg = it->satSolvable();
-		//MIL << "match " << package_id << " " << pkg << endl;
+	g_free (key);
+	g_strfreev (id_parts);
 
-		if (want_source && !isKind<SrcPackage>(pkg)) {
-			//MIL << "not a src package\n";
-			continue;
-		}
+	if (id == NULL)
+		return sat::Solvable::noSolvable;
 
-		if (!want_source && (isKind<SrcPackage>(pkg) || g_strcmp0 (pkg.arch().c_str(), arch))) {
-			//MIL << "not a matching arch\n";
-			continue;
-		}
+	sat::Solvable package (GPOINTER_TO_UINT (id));
+	MIL << "found " << package << endl;
+	return package;
+}
 
-		const string &ver = pkg.edition ().asString();
-		if (g_strcmp0 (ver.c_str (), id_parts[PK_PACKAGE_ID_VERSION])) {
-			//MIL << "not a matching version\n";
-			continue;
-		}
+/**
+ * Build what is otherwise built on demand when the pool is first used,
+ * called while the pool is loaded so the shared jobs only ever read it.
+ */
+static void
+zypp_prepare_pool ()
+{
+	sat::Pool::instance ().prepare ();
+	ResPool::instance ().proxy ();
+	zypp_get_package_id_index ();
+}
 
-		if (!pkg.isSystem()) {
-			if (!strncmp(id_parts[PK_PACKAGE_ID_DATA], "installed", 9)) {
-				//MIL << "pkg is not installed\n";
-				continue;
-			}
-			if (g_strcmp0(pkg.repository().alias().c_str(), id_parts[PK_PACKAGE_ID_DATA])) {
-				//MIL << "repo does not match\n";
-				continue;
-			}
-		} else if (strncmp(id_parts[PK_PACKAGE_ID_DATA], "installed", 9)) {
-			//MIL << "pkg installed\n";
-			continue;
-		}
+/**
+ * Let other read-only jobs use zypp while this one queries the pool,
+ * and let the next ones share it directly for a while.
+ */
+void
+ZyppJob::share()
+{
+	if (!_read_only || _shared)
+		return;
 
-		MIL << "found " << pkg << endl;
-		package = pkg;
-		break;
-	}
+	// a no-op unless the pool changed without being loaded again
+	zypp_prepare_pool ();
 
-	g_strfreev (id_parts);
-	return package;
+	// the jobs joining later skip loading the target, so it has to be there
+	Target_Ptr target = ZYppFactory::instance ().getZYpp ()->getTarget ();
+	Repository system = sat::Pool::instance ().reposFind (sat::Pool::systemRepoAlias ());
+
+	g_mutex_lock(&priv->zypp_mutex);
+	priv->currentJob = 0;
+	priv->eventDirector.setJob(0);
+	priv->writer = FALSE;
+	priv->readers++;
+	if (target != NULL && system != Repository::noRepository) {
+		priv->pool_target = target;
+		priv->pool_rpmdb = _pool_rpmdb;
+		priv->pool_shared_until = g_get_monotonic_time () +
+			ZYPP_SHARED_POOL_TIMEOUT * G_TIME_SPAN_SECOND;
+	}
+	_shared = TRUE;
+	g_cond_broadcast(&priv->zypp_cond);
+	g_mutex_unlock(&priv->zypp_mutex);
+	MIL << "sharing zypp" << std::endl;
 }
 
 RepoInfo
@@ -989,7 +1201,7 @@ zypp_get_Repository (PkBackendJob *job, const gchar *alias)
  * leads to multi-threaded use of zypp and hence sudden, random death.
  *
  * To cure this, we throw this custom exception across zypp and catch
- * it outside (hopefully) the only entry point (zypp_refresh_meta_and_cache)
+ * it outside (hopefully) the only entry point (zypp_refresh_meta)
  * that can cause these (zypp_signature_required) methods to be called.
  *
  */
@@ -999,33 +1211,49 @@ class AbortTransactionException {
 };
 
 /**
- * helper to refresh a repo's metadata and cache, catching signature
- * exceptions in a safe way.
+ * helper to refresh a repo's metadata, catching signature exceptions
+ * in a safe way. refreshed is set if new metadata was downloaded and
+ * the cache has to be built.
  */
 static gboolean
-zypp_refresh_meta_and_cache (RepoManager &manager, RepoInfo &repo, bool force = false)
+zypp_refresh_meta (RepoManager &manager, RepoInfo &repo, bool force, bool &refreshed)
 {
+	refreshed = false;
 	try {
 		if (manager.checkIfToRefreshMetadata (repo, repo.url())    //RepoManager::RefreshIfNeededIgnoreDelay)
 		    != RepoManager::REFRESH_NEEDED)
 			return TRUE;
 
-		sat::Pool pool = sat::Pool::instance ();
-		// Erase old solv file
-		pool.reposErase (repo.alias ());
 		manager.refreshMetadata (repo, force ?
 					 RepoManager::RefreshForced :
 					 RepoManager::RefreshIfNeededIgnoreDelay);
-		manager.buildCache (repo, force ?
-				    RepoManager::BuildForced :
-				    RepoManager::BuildIfNeeded);
-		manager.loadFromCache (repo);
+		refreshed = true;
 		return TRUE;
 	} catch (const AbortTransactionException &ex) {
 		return FALSE;
 	}
 }
 
+/**
+ * helper to refresh a repo's metadata and cache, catching signature
+ * exceptions in a safe way.
+ */
+static gboolean
+zypp_refresh_meta_and_cache (RepoManager &manager, RepoInfo &repo, bool force = false)
+{
+	bool refreshed;
+
+	if (!zypp_refresh_meta (manager, repo, force, refreshed))
+		return FALSE;
+	if (!refreshed)
+		return TRUE;
+
+	manager.buildCache (repo, force ?
+			    RepoManager::BuildForced :
+			    RepoManager::BuildIfNeeded);
+	zypp_pool_load_repo (manager, repo);
+	return TRUE;
+}
 
 static gboolean
 system_and_package_are_x86 (sat::Solvable item)
@@ -1112,35 +1340,35 @@ void
 zypp_emit_filtered_packages_in_list (PkBackendJob *job, PkBitfield filters, const vector<sat::Solvable> &v)
 {
 	typedef vector<sat::Solvable>::const_iterator sat_it_t;
+	typedef pair<sat::detail::IdType, pair<sat::detail::IdType, sat::detail::IdType> > nvra_t;
 
-	vector<sat::Solvable> installed;
+	// ident (name and kind), edition and arch of the installed packages
+	set<nvra_t> installed;
 
-	// always emit system installed packages first
+	// always emit system installed packages first, taking turns on the
+	// pool with the other shared jobs one package at a time
 	for (sat_it_t it = v.begin (); it != v.end (); ++it) {
+		ZyppPoolLock lock;
 		if (!it->isSystem() ||
 		    zypp_filter_solvable (filters, *it))
 			continue;
 
 		zypp_backend_package (job, PK_INFO_ENUM_INSTALLED, *it,
 				      make<ResObject>(*it)->summary().c_str());
-		installed.push_back (*it);
+		installed.insert (make_pair (it->ident ().id (),
+					     make_pair (it->edition ().id (), it->arch ().id ())));
 	}
 
-	// then available packages later
+	// then available packages later, unless they are installed
 	for (sat_it_t it = v.begin (); it != v.end (); ++it) {
-		gboolean match;
-
+		ZyppPoolLock lock;
 		if (it->isSystem() ||
 		    zypp_filter_solvable (filters, *it))
 			continue;
 
-		match = FALSE;
-		for (sat_it_t i = installed.begin (); !match && i != installed.end (); i++) {
-			match = it->sameNVRA (*i) &&
-				!(!isKind<SrcPackage>(*it) ^
-				  !isKind<SrcPackage>(*i));
-		}
-		if (!match) {
+		nvra_t nvra = make_pair (it->ident ().id (),
+					 make_pair (it->edition ().id (), it->arch ().id ()));
+		if (installed.find (nvra) == installed.end ()) {
 			zypp_backend_package (job, PK_INFO_ENUM_AVAILABLE, *it,
 					      make<ResObject>(*it)->summary().c_str());
 		}
@@ -1244,6 +1472,9 @@ zypp_get_updates (PkBackendJob *job, ZYpp::Ptr zypp, set<PoolItem> &candidates)
 			set<PoolItem> packages;
 			zypp_get_package_updates(patchRepo, packages);
 
+			// Mark the packages contained in the patches, and the ones
+			// identical to them from other repos, by solvable id
+			vector<bool> in_patch (sat::Pool::instance ().capacity (), false);
 			pi_it_t cb = candidates.begin (), ce = candidates.end (), ci;
 			for (ci = cb; ci != ce; ++ci) {
 				if (!isKind<Patch>(ci->resolvable()))
@@ -1251,24 +1482,32 @@ zypp_get_updates (PkBackendJob *job, ZYpp::Ptr zypp, set<PoolItem> &candidates)
 
 				Patch::constPtr patch = asKind<Patch>(ci->resolvable());
 
-				// Remove contained packages from list of packages to add
 				sat::SolvableSet::const_iterator pki;
 				Patch::Contents content(patch->contents());
 				for (pki = content.begin(); pki != content.end(); ++pki) {
+					ui::Selectable::Ptr s = ui::Selectable::get (*pki);
+					if (!s)
+						continue;
 
-					pi_it_t pb = packages.begin (), pe = packages.end (), pi;
-					for (pi = pb; pi != pe; ++pi) {
-						if (pi->satSolvable() == sat::Solvable::noSolvable)
-							continue;
-
-						if (pi->satSolvable().identical (*pki)) {
-							packages.erase (pi);
-							break;
-						}
+					ui::Selectable::available_iterator ai;
+					for (ai = s->availableBegin (); ai != s->availableEnd (); ++ai) {
+						if (ai->satSolvable ().identical (*pki))
+							in_patch[ai->satSolvable ().id ()] = true;
 					}
 				}
 			}
 
+			// Remove contained packages from list of packages to add
+			for (pi_it_t pi = packages.begin (); pi != packages.end (); ) {
+				sat::Solvable solvable = pi->satSolvable ();
+				if (solvable != sat::Solvable::noSolvable &&
+				    solvable.id () < in_patch.size () &&
+				    in_patch[solvable.id ()])
+					packages.erase (pi++);
+				else
+					++pi;
+			}
+
 			// merge into the list
 			candidates.insert (packages.begin (), packages.end ());
 		}
@@ -1532,6 +1771,107 @@ zypp_build_package_id_capabilities (Capabilities caps, gboolean terminate = TRUE
 	return package_ids;
 }
 
+/**
+ * What the last zypp_refresh_cache() saw, so searches can tell
+ * if they need to reload anything before querying the pool
+ */
+static struct {
+	time_t last;
+	Date rpmdb;
+	string repos;
+} _refresh_state = { 0, Date (), string () };
+
+/**
+  * build a string that changes when the repository configuration
+  * or the downloaded metadata of an enabled repository changes
+  */
+static string
+zypp_repos_stamp ()
+{
+	std::ostringstream stamp;
+
+	try {
+		RepoManager manager;
+		for (RepoManager::RepoConstIterator it = manager.repoBegin(); it != manager.repoEnd(); ++it) {
+			if (it->enabled () == false)
+				continue;
+			RepoStatus status = manager.metadataStatus (*it);
+			stamp << it->alias () << ":" << status.checksum () << ";";
+		}
+	} catch (const Exception &ex) {
+		// let the refresh report the error
+		return string ();
+	}
+
+	stamp << PathInfo (ZConfig::instance ().knownReposPath ()).mtime ();
+	return stamp.str ();
+}
+
+/**
+  * remember the state after a refresh of the target and repositories
+  */
+static void
+zypp_refresh_done (ZYpp::Ptr zypp)
+{
+	_refresh_state.last = time (NULL);
+	_refresh_state.rpmdb = zypp->target ()->rpmDb ().timestamp ();
+	_refresh_state.repos = zypp_repos_stamp ();
+}
+
+/**
+ * Add a line about a repository that could not be refreshed
+ */
+static void
+zypp_refresh_add_message (gchar **repo_messages, const RepoInfo &repo, const string &error)
+{
+	gchar *tmp;
+
+	if (*repo_messages == NULL) {
+		tmp = g_strdup_printf ("%s: %s%s", repo.alias ().c_str (), error.c_str (), "\n");
+	} else {
+		tmp = g_strdup_printf ("%s%s: %s%s", *repo_messages, repo.alias ().c_str (), error.c_str (), "\n");
+	}
+	g_free (*repo_messages);
+	*repo_messages = tmp;
+
+	if (*repo_messages == NULL || !g_utf8_validate (*repo_messages, -1, NULL)) {
+		g_free (*repo_messages);
+		*repo_messages = g_strdup ("A repository could not be refreshed");
+	}
+	g_strdelimit (*repo_messages, "\\\f\r\t", ' ');
+}
+
+/**
+ * Load the repositories whose cache is built into the pool
+ * \returns how many were loaded
+ */
+static guint
+zypp_refresh_load_built (RepoManager &manager, ZyppCacheBuilder &builder,
+			 gchar **repo_messages, bool block)
+{
+	RepoInfo repo;
+	string error;
+	guint loaded = 0;
+
+	while (builder.next (repo, error, block)) {
+		if (error.empty ()) {
+			try {
+				zypp_pool_load_repo (manager, repo);
+			} catch (const Exception &ex) {
+				error = ex.asUserString ();
+			}
+		}
+		if (!error.empty ())
+			zypp_refresh_add_message (repo_messages, repo, error);
+
+		MIL << "refreshed " << repo.alias () << endl;
+		loaded++;
+		if (block)
+			break;
+	}
+	return loaded;
+}
+
 /**
   * refresh the enabled repositories
   */
@@ -1564,55 +1904,117 @@ zypp_refresh_cache (PkBackendJob *job, ZYpp::Ptr zypp, gboolean force)
 		return FALSE;
 	}
 
-	int i = 1;
-	int num_of_repos = repos.size ();
+	// Every repo counts twice for the progress, once for downloading
+	// the metadata and once for building its cache
+	guint steps = 0;
+	guint num_of_steps = 2 * repos.size ();
+	gboolean ret = TRUE;
 	gchar *repo_messages = NULL;
 
-	for (list <RepoInfo>::iterator it = repos.begin(); it != repos.end(); ++it, i++) {
+	// The metadata is downloaded here one repo after the other. The
+	// caches are built by the builder meanwhile, and loaded into the
+	// pool here.
+	ZyppCacheBuilder builder (RepoManagerOptions (), priv->max_parallel_refreshes);
+
+	for (list <RepoInfo>::iterator it = repos.begin(); it != repos.end(); ++it) {
 		RepoInfo repo (*it);
 
-		if (!zypp_is_valid_repo (job, repo))
-			return FALSE;
+		// load what was built in the meantime
+		steps += zypp_refresh_load_built (manager, builder, &repo_messages, false);
+
+		if (!zypp_is_valid_repo (job, repo)) {
+			ret = FALSE;
+			break;
+		}
 		if (pk_backend_job_get_is_error_set (job))
 			break;
 
-		// skip disabled repos
-		if (repo.enabled () == false)
-			continue;
-
-		// do as zypper does
-		if (!force && !repo.autorefresh())
-			continue;
+		steps++;
+		pk_backend_job_set_percentage (job, (100 * steps) / num_of_steps);
 
+		// skip disabled repos
+		// do as zypper does, and skip repos not set to autorefresh
 		// skip changeable meda (DVDs and CDs).  Without doing this,
 		// the disc would be required to be physically present.
-		if (zypp_is_changeable_media (*repo.baseUrlsBegin ()) == true)
+		if (repo.enabled () == false ||
+		    (!force && !repo.autorefresh()) ||
+		    zypp_is_changeable_media (*repo.baseUrlsBegin ()) == true) {
+			steps++;
 			continue;
+		}
 
+		bool refreshed = false;
 		try {
 			// Refreshing metadata
 			g_free (_repoName);
 			_repoName = g_strdup (repo.alias ().c_str ());
-			zypp_refresh_meta_and_cache (manager, repo, force);
+			zypp_refresh_meta (manager, repo, force, refreshed);
 		} catch (const Exception &ex) {
-			if (repo_messages == NULL) {
-				repo_messages = g_strdup_printf ("%s: %s%s", repo.alias ().c_str (), ex.asUserString ().c_str (), "\n");
-			} else {
-				repo_messages = g_strdup_printf ("%s%s: %s%s", repo_messages, repo.alias ().c_str (), ex.asUserString ().c_str (), "\n");
-			}
-			if (repo_messages == NULL || !g_utf8_validate (repo_messages, -1, NULL))
-				repo_messages = g_strdup ("A repository could not be refreshed");
-			g_strdelimit (repo_messages, "\\\f\r\t", ' ');
+			zypp_refresh_add_message (&repo_messages, repo, ex.asUserString ());
+		}
+
+		if (!refreshed) {
+			steps++;
 			continue;
 		}
 
-		// Update the percentage completed
-		pk_backend_job_set_percentage (job, i >= num_of_repos ? 100 : (100 * i) / num_of_repos);
+		builder.add (repo, force);
+	}
+
+	// wait for the caches still being built
+	while (builder.pending () > 0) {
+		steps += zypp_refresh_load_built (manager, builder, &repo_messages, true);
+		pk_backend_job_set_percentage (job, (100 * steps) / num_of_steps);
+	}
+
+	if (!ret) {
+		g_free (repo_messages);
+		return FALSE;
 	}
+
+	pk_backend_job_set_percentage (job, 100);
 	if (repo_messages != NULL)
 		pk_backend_job_message (job, PK_MESSAGE_ENUM_CONNECTION_REFUSED, repo_messages);
 
 	g_free (repo_messages);
+
+	zypp_prepare_pool ();
+	zypp_refresh_done (zypp);
+	return TRUE;
+}
+
+/**
+  * refresh the target and the repositories only if something
+  * changed since the last refresh, or the repos are due again
+  */
+static gboolean
+zypp_refresh_cache_if_needed (PkBackendJob *job, ZYpp::Ptr zypp)
+{
+	if (zypp == NULL)
+		return FALSE;
+
+	time_t now = time (NULL);
+	time_t delay = ZConfig::instance ().repo_refresh_delay () * 60;
+
+	// repos were added, changed, or refreshed by somebody else,
+	// or it is time to check the autorefresh ones for updates
+	if (_refresh_state.last == 0 ||
+	    now < _refresh_state.last ||
+	    now - _refresh_state.last >= delay ||
+	    zypp_repos_stamp () != _refresh_state.repos) {
+		MIL << "repositories changed or due for refresh" << endl;
+		return zypp_refresh_cache (job, zypp, FALSE);
+	}
+
+	// only the installed packages changed, e.g. after rpm -i
+	if (zypp->target ()->rpmDb ().timestamp () != _refresh_state.rpmdb) {
+		MIL << "rpm database changed, reloading the target" << endl;
+		filesystem::Pathname pathname("/");
+		zypp->finishTarget ();
+		zypp->initializeTarget (pathname);
+		_refresh_state.rpmdb = zypp->target ()->rpmDb ().timestamp ();
+	}
+
 	return TRUE;
 }
 
@@ -1641,12 +2043,12 @@ zypp_backend_finished_error (PkBackendJob  *job, PkErrorEnum err_code,
 
 
 /**
- * We do not pretend we're thread safe when all we do is having a huge mutex
+ * Read-only jobs share zypp while no other job changes it, see ZyppJob
  */
 gboolean
 pk_backend_supports_parallelization (PkBackend *backend)
 {
-        return FALSE;
+        return TRUE;
 }
 
 
@@ -1681,7 +2083,16 @@ pk_backend_initialize (GKeyFile *conf, PkBackend *backend)
 	/* create private area */
 	priv = new PkBackendZYppPrivate;
 	priv->currentJob = 0;
-	priv->zypp_mutex = PTHREAD_MUTEX_INITIALIZER;
+	g_mutex_init (&priv->zypp_mutex);
+	g_cond_init (&priv->zypp_cond);
+	priv->readers = 0;
+	priv->writers_waiting = 0;
+	priv->writer = FALSE;
+	priv->pool_shared_until = 0;
+	g_rec_mutex_init (&priv->pool_mutex);
+	priv->max_parallel_refreshes = g_key_file_get_integer (conf, "Daemon", "MaximumParallelRefreshes", NULL);
+	if (priv->max_parallel_refreshes <= 0)
+		priv->max_parallel_refreshes = 4;
 	zypp_logging ();
 
 	g_debug ("zypp_backend_initialize");
@@ -1698,6 +2109,11 @@ pk_backend_destroy (PkBackend *backend)
 	g_debug ("zypp_backend_destroy");
 
 	g_free (_repoName);
+	if (_package_id_index != NULL)
+		g_hash_table_unref (_package_id_index);
+	g_mutex_clear (&priv->zypp_mutex);
+	g_cond_clear (&priv->zypp_cond);
+	g_rec_mutex_clear (&priv->pool_mutex);
 	delete priv;
 }
 
@@ -1708,6 +2124,51 @@ zypp_is_no_solvable (const sat::Solvable &solv)
 	return solv.id() == sat::detail::noSolvableId;
 }
 
+/**
+ * The installed packages requiring each installed package, indexed by
+ * solvable id, and the serial of the pool the index was built for.
+ */
+static vector< vector<sat::detail::IdType> > _reverse_requires;
+static unsigned _reverse_requires_serial = 0;
+
+/**
+ * (Re)build the reverse requires of the installed packages
+ * if the pool changed since they were built
+ */
+static const vector< vector<sat::detail::IdType> > &
+zypp_get_reverse_requires ()
+{
+	unsigned serial = sat::Pool::instance ().serial ().serial ();
+
+	if (!_reverse_requires.empty () && _reverse_requires_serial == serial)
+		return _reverse_requires;
+
+	vector< vector<sat::detail::IdType> > index (sat::Pool::instance ().capacity ());
+	Repository system = sat::Pool::instance ().reposFind (sat::Pool::systemRepoAlias ());
+
+	for (Repository::SolvableIterator it = system.solvablesBegin (); it != system.solvablesEnd (); ++it) {
+		Capabilities req = (*it)[Dep::REQUIRES];
+		for (Capabilities::const_iterator cap = req.begin (); cap != req.end (); ++cap) {
+			sat::WhatProvides prov_list (*cap);
+			for (sat::WhatProvides::const_iterator provider = prov_list.begin ();
+			     provider != prov_list.end (); ++provider) {
+				if (!provider->isSystem () || *provider == *it)
+					continue;
+
+				vector<sat::detail::IdType> &requiring = index[provider->id ()];
+				// the requires of one package are walked together
+				if (requiring.empty () || requiring.back () != it->id ())
+					requiring.push_back (it->id ());
+			}
+		}
+	}
+
+	_reverse_requires.swap (index);
+	_reverse_requires_serial = serial;
+
+	return _reverse_requires;
+}
+
 /**
   * backend_required_by_thread:
   */
@@ -1737,7 +2198,7 @@ backend_required_by_thread (PkBackendJob *job, GVariant *params, gpointer user_d
 	pk_backend_job_set_percentage (job, 10);
 
 	ResPool pool = zypp_build_pool (zypp, true);
-	PoolStatusSaver saver;
+	vector<sat::Solvable> packages;
 	for (uint i = 0; package_ids[i]; i++) {
 		sat::Solvable solvable = zypp_get_package_by_id (package_ids[i]);
 
@@ -1747,46 +2208,86 @@ backend_required_by_thread (PkBackendJob *job, GVariant *params, gpointer user_d
 			return;
 		}
 
-		PoolItem package = PoolItem(solvable);
-
 		// required-by only works for installed packages. It's meaningless for stuff in the repo
 		// same with yum backend
 		if (!solvable.isSystem ())
 			continue;
-		// set Package as to be uninstalled
-		package.status ().setToBeUninstalled (ResStatus::USER);
+		packages.push_back (solvable);
+	}
 
-		// solver run
-		ResPool pool = ResPool::instance ();
-		Resolver solver(pool);
+	if (packages.empty ()) {
+		pk_backend_job_finished (job);
+		return;
+	}
 
-		solver.setForceResolve (true);
-		solver.setIgnoreAlreadyRecommended (TRUE);
+	// Only the installed packages requiring these directly, no need for the solver
+	if (!recursive) {
+		const vector< vector<sat::detail::IdType> > &index = zypp_get_reverse_requires ();
+		vector<bool> seen (sat::Pool::instance ().capacity (), false);
 
-		if (!solver.resolvePool ()) {
-			string problem = "Resolution failed: ";
-			list<ResolverProblem_Ptr> problems = solver.problems ();
-			for (list<ResolverProblem_Ptr>::iterator it = problems.begin (); it != problems.end (); ++it){
-				problem += (*it)->description ();
+		for (vector<sat::Solvable>::const_iterator it = packages.begin (); it != packages.end (); ++it)
+			seen[it->id ()] = true;
+
+		for (vector<sat::Solvable>::const_iterator it = packages.begin (); it != packages.end (); ++it) {
+			if (it->id () >= index.size ())
+				continue;
+
+			const vector<sat::detail::IdType> &requiring = index[it->id ()];
+			for (vector<sat::detail::IdType>::const_iterator rit = requiring.begin (); rit != requiring.end (); ++rit) {
+				if (seen[*rit])
+					continue;
+				seen[*rit] = true;
+
+				sat::Solvable solvable (*rit);
+				if (zypp_filter_solvable (_filters, solvable))
+					continue;
+
+				PoolItem item (solvable);
+				zypp_backend_package (job, PK_INFO_ENUM_INSTALLED, solvable,
+						      item->summary ().c_str ());
 			}
-			zypp_backend_finished_error (
-				job, PK_ERROR_ENUM_DEP_RESOLUTION_FAILED,
-				problem.c_str());
-			return;
 		}
 
-		// look for packages which would be uninstalled
-		bool error = false;
-		for (ResPool::byKind_iterator it = pool.byKindBegin (ResKind::package);
-				it != pool.byKindEnd (ResKind::package); ++it) {
+		pk_backend_job_finished (job);
+		return;
+	}
 
-			if (!error && !zypp_filter_solvable (_filters, it->resolvable()->satSolvable()))
-				error = !zypp_backend_pool_item_notify (job, *it);
+	// set all the packages as to be uninstalled at once
+	PoolStatusSaver saver;
+	for (vector<sat::Solvable>::const_iterator it = packages.begin (); it != packages.end (); ++it) {
+		PoolItem package = PoolItem(*it);
+		package.status ().setToBeUninstalled (ResStatus::USER);
+	}
+
+	// solver run
+	Resolver solver(pool);
+
+	solver.setForceResolve (true);
+	solver.setIgnoreAlreadyRecommended (TRUE);
+
+	if (!solver.resolvePool ()) {
+		string problem = "Resolution failed: ";
+		list<ResolverProblem_Ptr> problems = solver.problems ();
+		for (list<ResolverProblem_Ptr>::iterator it = problems.begin (); it != problems.end (); ++it){
+			problem += (*it)->description ();
 		}
+		zypp_backend_finished_error (
+			job, PK_ERROR_ENUM_DEP_RESOLUTION_FAILED,
+			problem.c_str());
+		return;
+	}
+
+	// look for packages which would be uninstalled
+	bool error = false;
+	for (ResPool::byKind_iterator it = pool.byKindBegin (ResKind::package);
+			it != pool.byKindEnd (ResKind::package); ++it) {
 
-		solver.setForceResolve (false);
+		if (!error && !zypp_filter_solvable (_filters, it->resolvable()->satSolvable()))
+			error = !zypp_backend_pool_item_notify (job, *it);
 	}
 
+	solver.setForceResolve (false);
+
 	pk_backend_job_finished (job);
 }
 
@@ -1839,6 +2340,48 @@ pk_backend_get_filters (PkBackend *backend)
 				       -1);
 }
 
+/**
+  * Returns the package chosen to provide a capability, preferring the
+  * ones already chosen for another capability, then installed ones
+  */
+static sat::Solvable
+zypp_get_preferred_provider (const Capability &cap, const map<IdString, sat::Solvable> &chosen)
+{
+	// Look for packages providing the capability
+	bool have_preference = false;
+	sat::Solvable preferred;
+
+	sat::WhatProvides prov_list (cap);
+	for (sat::WhatProvides::const_iterator provider = prov_list.begin ();
+	     provider != prov_list.end (); provider++) {
+
+		g_debug ("provider: '%s'", provider->asString().c_str());
+
+		// filter out caps like "rpmlib(PayloadFilesHavePrefix) <= 4.0-1" (bnc#372429)
+		if (zypp_is_no_solvable (*provider))
+			continue;
+
+		// Is this capability provided by a package we already have listed ?
+		map<IdString, sat::Solvable>::const_iterator listed = chosen.find (provider->ident ());
+		if (listed != chosen.end ())
+			return listed->second;
+
+		// Something is better than nothing
+		if (!have_preference) {
+			preferred = *provider;
+			have_preference = true;
+
+		// Prefer system packages
+		} else if (provider->isSystem()) {
+			preferred = *provider;
+			break;
+
+		} // else keep our first love
+	}
+
+	return preferred;
+}
+
 /*
  * This method is a bit of a travesty of the complexity of
  * solving dependencies. We try to give a simple answer to
@@ -1871,102 +2414,88 @@ backend_depends_on_thread (PkBackendJob *job, GVariant *params, gpointer user_da
 
 	try
 	{
-		sat::Solvable solvable = zypp_get_package_by_id(package_ids[0]);
-		
-		pk_backend_job_set_percentage (job, 20);
+		// the packages whose requirements were walked, by solvable id
+		vector<bool> visited (sat::Pool::instance ().capacity (), false);
+		deque<sat::Solvable> queue;
 
-		if (zypp_is_no_solvable(solvable)) {
-			zypp_backend_finished_error (
-				job, PK_ERROR_ENUM_DEP_RESOLUTION_FAILED,
-				"Did not find the specified package.");
-			return;
+		for (guint i = 0; package_ids[i]; i++) {
+			sat::Solvable solvable = zypp_get_package_by_id(package_ids[i]);
+
+			if (zypp_is_no_solvable(solvable)) {
+				zypp_backend_finished_error (
+					job, PK_ERROR_ENUM_DEP_RESOLUTION_FAILED,
+					"Did not find the specified package.");
+				return;
+			}
+
+			queue.push_back (solvable);
 		}
 
 		// Gather up any dependencies
 		pk_backend_job_set_status (job, PK_STATUS_ENUM_DEP_RESOLVE);
-		pk_backend_job_set_percentage (job, 60);
-
-		// get dependencies
-		Capabilities req = solvable[Dep::REQUIRES];
+		pk_backend_job_set_percentage (job, 20);
 
-		// which package each capability
-		map<string, sat::Solvable> caps;
-		// packages already providing a capability
-		vector<string> pkg_names;
+		// which package was chosen for each capability
+		map<sat::detail::IdType, sat::Solvable> caps;
+		// packages already providing a capability, by name
+		map<IdString, sat::Solvable> chosen;
+		guint done = 0;
 
-		for (Capabilities::const_iterator cap = req.begin (); cap != req.end (); ++cap) {
-			g_debug ("depends_on - capability '%s'", cap->asString().c_str());
+		while (!queue.empty ()) {
+			sat::Solvable solvable = queue.front ();
+			queue.pop_front ();
 
-			if (caps.find (cap->asString ()) != caps.end()) {
-				g_debug ("Interesting ! already have capability '%s'", cap->asString().c_str());
+			// asked for twice, or also a dependency of another one
+			if (visited[solvable.id ()])
 				continue;
-			}
+			visited[solvable.id ()] = true;
 
-			// Look for packages providing each capability
-			bool have_preference = false;
-			sat::Solvable preferred;
+			// get dependencies
+			Capabilities req = solvable[Dep::REQUIRES];
 
-			sat::WhatProvides prov_list (*cap);
-			for (sat::WhatProvides::const_iterator provider = prov_list.begin ();
-			     provider != prov_list.end (); provider++) {
+			for (Capabilities::const_iterator cap = req.begin (); cap != req.end (); ++cap) {
+				g_debug ("depends_on - capability '%s'", cap->asString().c_str());
 
-				g_debug ("provider: '%s'", provider->asString().c_str());
+				sat::Solvable preferred;
+				map<sat::detail::IdType, sat::Solvable>::const_iterator cached = caps.find (cap->id ());
+				if (cached != caps.end ()) {
+					preferred = cached->second;
+				} else {
+					preferred = zypp_get_preferred_provider (*cap, chosen);
+					caps[cap->id ()] = preferred;
+				}
 
-				// filter out caps like "rpmlib(PayloadFilesHavePrefix) <= 4.0-1" (bnc#372429)
-				if (zypp_is_no_solvable (*provider))
+				// each name is listed once
+				if (zypp_is_no_solvable (preferred) ||
+				    chosen.find (preferred.ident ()) != chosen.end ())
 					continue;
+				chosen[preferred.ident ()] = preferred;
 
-				// Is this capability provided by a package we already have listed ?
-				if (find (pkg_names.begin (), pkg_names.end(),
-					       provider->name ()) != pkg_names.end()) {
-					preferred = *provider;
-					have_preference = true;
-					break;
-				}
+				// backup sanity check for no-solvables
+				if (! preferred.name ().c_str() ||
+				    preferred.name ().c_str()[0] == '\0')
+					continue;
 
-				// Something is better than nothing
-				if (!have_preference) {
-					preferred = *provider;
-					have_preference = true;
+				PoolItem item(preferred);
+				PkInfoEnum info = preferred.isSystem () ? PK_INFO_ENUM_INSTALLED : PK_INFO_ENUM_AVAILABLE;
 
-				// Prefer system packages
-				} else if (provider->isSystem()) {
-					preferred = *provider;
-					break;
+				g_debug ("add dep - '%s' '%s' %d [%s]", preferred.name().c_str(),
+					 info == PK_INFO_ENUM_INSTALLED ? "installed" : "available",
+					 preferred.isSystem(),
+					 zypp_filter_solvable (_filters, preferred) ? "don't add" : "add" );
 
-				} // else keep our first love
-			}
+				if (!zypp_filter_solvable (_filters, preferred)) {
+					zypp_backend_package (job, info, preferred,
+							      item->summary ().c_str());
+				}
 
-			if (have_preference &&
-			    find (pkg_names.begin (), pkg_names.end(),
-				       preferred.name ()) == pkg_names.end()) {
-				caps[cap->asString()] = preferred;
-				pkg_names.push_back (preferred.name ());
+				// and the dependencies of the dependency
+				if (recursive && !visited[preferred.id ()])
+					queue.push_back (preferred);
 			}
-		}
-
-		// print dependencies
-		for (map<string, sat::Solvable>::iterator it = caps.begin ();
-		     it != caps.end();
-		     ++it) {
-			
-			// backup sanity check for no-solvables
-			if (! it->second.name ().c_str() ||
-			    it->second.name ().c_str()[0] == '\0')
-				continue;
-			
-			PoolItem item(it->second);
-			PkInfoEnum info = it->second.isSystem () ? PK_INFO_ENUM_INSTALLED : PK_INFO_ENUM_AVAILABLE;
 
-			g_debug ("add dep - '%s' '%s' %d [%s]", it->second.name().c_str(),
-				 info == PK_INFO_ENUM_INSTALLED ? "installed" : "available",
-				 it->second.isSystem(),
-				 zypp_filter_solvable (_filters, it->second) ? "don't add" : "add" );
-
-			if (!zypp_filter_solvable (_filters, it->second)) {
-				zypp_backend_package (job, info, it->second,
-						      item->summary ().c_str());
-			}
+			done++;
+			pk_backend_job_set_percentage (job, 20 + (80 * done) / (done + queue.size ()));
 		}
 
 		pk_backend_job_set_percentage (job, 100);
@@ -2001,7 +2530,7 @@ backend_get_details_thread (PkBackendJob *job, GVariant *params, gpointer user_d
 	g_variant_get (params, "(^a&s)",
 		       &package_ids);
 
-	ZyppJob zjob(job);
+	ZyppJob zjob(job, TRUE);
 	ZYpp::Ptr zypp = zjob.get_zypp();
 
 	if (zypp == NULL){
@@ -2010,10 +2539,12 @@ backend_get_details_thread (PkBackendJob *job, GVariant *params, gpointer user_d
 	}
 
 	pk_backend_job_set_status (job, PK_STATUS_ENUM_QUERY);
+	zjob.share ();
 
 	for (uint i = 0; package_ids[i]; i++) {
 		MIL << package_ids[i] << endl;
 
+		ZyppPoolLock lock;
 		sat::Solvable solv = zypp_get_package_by_id( package_ids[i] );
 
 		ResObject::constPtr obj = make<ResObject>( solv );
@@ -2687,7 +3218,7 @@ backend_resolve_thread (PkBackendJob *job, GVariant *params, gpointer user_data)
 		      &_filters,
 		      &search);
 
-	ZyppJob zjob(job);
+	ZyppJob zjob(job, TRUE);
 	ZYpp::Ptr zypp = zjob.get_zypp();
 	
 	if (zypp == NULL){
@@ -2697,10 +3228,13 @@ backend_resolve_thread (PkBackendJob *job, GVariant *params, gpointer user_data)
 	
 	pk_backend_job_set_status (job, PK_STATUS_ENUM_QUERY);
 
-	zypp_build_pool (zypp, TRUE);
+	if (!zjob.is_shared ())
+		zypp_build_pool (zypp, TRUE);
+	zjob.share ();
 
 	for (uint i = 0; search[i]; i++) {
 		MIL << search[i] << " " << pk_filter_bitfield_to_string(_filters) << endl;
+		ZyppPoolLock lock;
 		vector<sat::Solvable> v;
 		
 		/* build a list of packages with this name */
@@ -2774,7 +3308,6 @@ static void
 backend_find_packages_thread (PkBackendJob *job, GVariant *params, gpointer user_data)
 {
 	MIL << endl;
-	const gchar *search;
 	PkRoleEnum role;
 
 	PkBitfield _filters;
@@ -2783,7 +3316,7 @@ backend_find_packages_thread (PkBackendJob *job, GVariant *params, gpointer user
 		&_filters,
 		&values);
 
-	ZyppJob zjob(job);
+	ZyppJob zjob(job, TRUE);
 	ZYpp::Ptr zypp = zjob.get_zypp();
 	
 	if (zypp == NULL){
@@ -2791,13 +3324,12 @@ backend_find_packages_thread (PkBackendJob *job, GVariant *params, gpointer user
 		return;
 	}
 
-	// refresh the repos before searching
-	if (!zypp_refresh_cache (job, zypp, FALSE)) {
+	// refresh the repos before searching, if anything changed
+	if (!zjob.is_shared () && !zypp_refresh_cache_if_needed (job, zypp)) {
 		pk_backend_job_finished (job);
 		return;
 	}
 
-	search = values[0];  //Fixme - support the possible multiple values (logical OR search)
 	role = pk_backend_job_get_role(job);
 
 	pk_backend_job_set_status (job, PK_STATUS_ENUM_QUERY);
@@ -2806,13 +3338,15 @@ backend_find_packages_thread (PkBackendJob *job, GVariant *params, gpointer user
 	vector<sat::Solvable> v;
 
 	PoolQuery q;
-	q.addString( search ); // may be called multiple times (OR'ed)
+	for (guint i = 0; values[i]; i++)
+		q.addString( values[i] ); // the values are OR'ed
 	q.setCaseSensitive( true );
 	q.setMatchSubstring();
 
 	switch (role) {
 	case PK_ROLE_ENUM_SEARCH_NAME:
-		zypp_build_pool (zypp, TRUE); // seems to be necessary?
+		if (!zjob.is_shared ())
+			zypp_build_pool (zypp, TRUE); // seems to be necessary?
 		q.addKind( ResKind::package );
 		q.addKind( ResKind::srcpackage );
 		q.addAttribute( sat::SolvAttr::name );
@@ -2821,7 +3355,8 @@ backend_find_packages_thread (PkBackendJob *job, GVariant *params, gpointer user
 		// two separate queries.
 		break;
 	case PK_ROLE_ENUM_SEARCH_DETAILS:
-		zypp_build_pool (zypp, TRUE); // seems to be necessary?
+		if (!zjob.is_shared ())
+			zypp_build_pool (zypp, TRUE); // seems to be necessary?
 		q.addKind( ResKind::package );
 		//q.addKind( ResKind::srcpackage );
 		q.addAttribute( sat::SolvAttr::name );
@@ -2830,7 +3365,8 @@ backend_find_packages_thread (PkBackendJob *job, GVariant *params, gpointer user
 		// did not search in srcpackages.
 		break;
 	case PK_ROLE_ENUM_SEARCH_FILE: {
-		zypp_build_pool (zypp, TRUE);
+		if (!zjob.is_shared ())
+			zypp_build_pool (zypp, TRUE);
 		q.addKind( ResKind::package );
 		q.addAttribute( sat::SolvAttr::name );
 		q.addAttribute( sat::SolvAttr::description );
@@ -2843,8 +3379,18 @@ backend_find_packages_thread (PkBackendJob *job, GVariant *params, gpointer user
 		break;
 	};
 
+	zjob.share ();
+
 	if ( ! q.empty() ) {
-		copy( q.begin(), q.end(), back_inserter( v ) );
+		ZyppPoolLock lock;
+		// a solvable matching several values is listed once
+		vector<bool> found (sat::Pool::instance ().capacity (), false);
+		for (PoolQuery::const_iterator it = q.begin (); it != q.end (); ++it) {
+			if (found[it->id ()])
+				continue;
+			found[it->id ()] = true;
+			v.push_back (*it);
+		}
 	}
 	zypp_emit_filtered_packages_in_list (job, _filters, v);
 
@@ -2881,7 +3427,7 @@ backend_search_group_thread (PkBackendJob *job, GVariant *params, gpointer user_
 		&_filters,
 		&search);
 
-	ZyppJob zjob(job);
+	ZyppJob zjob(job, TRUE);
 	ZYpp::Ptr zypp = zjob.get_zypp();
 
 	if (zypp == NULL){
@@ -2900,19 +3446,24 @@ backend_search_group_thread (PkBackendJob *job, GVariant *params, gpointer user_
 	pk_backend_job_set_status (job, PK_STATUS_ENUM_QUERY);
 	pk_backend_job_set_percentage (job, 0);
 
-	ResPool pool = zypp_build_pool (zypp, true);
+	if (!zjob.is_shared ())
+		zypp_build_pool (zypp, true);
+	zjob.share ();
 
 	pk_backend_job_set_percentage (job, 30);
 
 	vector<sat::Solvable> v;
 	PkGroupEnum pkGroup = pk_group_enum_from_string (group);
 
-	sat::LookupAttr look (sat::SolvAttr::group);
+	{
+		ZyppPoolLock lock;
+		sat::LookupAttr look (sat::SolvAttr::group);
 
-	for (sat::LookupAttr::iterator it = look.begin (); it != look.end (); ++it) {
-		PkGroupEnum rpmGroup = get_enum_group (it.asString ());
-		if (pkGroup == rpmGroup)
-			v.push_back (it.inSolvable ());
+		for (sat::LookupAttr::iterator it = look.begin (); it != look.end (); ++it) {
+			PkGroupEnum rpmGroup = get_enum_group (it.asString ());
+			if (pkGroup == rpmGroup)
+				v.push_back (it.inSolvable ());
+		}
 	}
 
 	pk_backend_job_set_percentage (job, 70);
@@ -3035,6 +3586,88 @@ pk_backend_repo_enable (PkBackend *backend, PkBackendJob *job, const gchar *rid,
 	pk_backend_job_finished (job);
 }
 
+/**
+ * Collects the files of a package in one buffer instead of a
+ * string each, and emits them in a single Files signal, clients
+ * only expect one per package
+ */
+class FilesEmitter
+{
+ public:
+	FilesEmitter(PkBackendJob *job, const gchar *package_id)
+		: _job(job), _package_id(package_id)
+	{
+	}
+
+	void reserve(size_t files) {
+		_offsets.reserve (files);
+	}
+
+	void add(const char *file) {
+		add (NULL, file);
+	}
+
+	void add(const char *dir, const char *base) {
+		_offsets.push_back (_buffer.size ());
+		if (dir != NULL)
+			_buffer.append (dir);
+		_buffer.append (base);
+		_buffer.push_back ('\0');
+	}
+
+	// emits the files, or an empty list if the package has none
+	void emit() {
+		vector<gchar *> files;
+		files.reserve (_offsets.size () + 1);
+		for (vector<size_t>::iterator it = _offsets.begin (); it != _offsets.end (); ++it)
+			files.push_back (&_buffer[*it]);
+		files.push_back (NULL);
+		pk_backend_job_files (_job, _package_id, &files[0]);
+	}
+
+ private:
+	PkBackendJob *_job;
+	const gchar *_package_id;
+	string _buffer;
+	vector<size_t> _offsets;
+};
+
+/**
+  * Adds the files of an installed package, reading the names from the
+  * arrays of the rpm header in place rather than building a list
+  */
+static void
+zypp_add_header_files (FilesEmitter &files, const target::rpm::RpmHeader::constPtr &header)
+{
+	Header h = header->get ();
+	rpmtd basenames = rpmtdNew ();
+	rpmtd dirnames = rpmtdNew ();
+	rpmtd dirindexes = rpmtdNew ();
+
+	if (h != NULL &&
+	    headerGet (h, RPMTAG_BASENAMES, basenames, HEADERGET_MINMEM) &&
+	    headerGet (h, RPMTAG_DIRNAMES, dirnames, HEADERGET_MINMEM) &&
+	    headerGet (h, RPMTAG_DIRINDEXES, dirindexes, HEADERGET_MINMEM)) {
+		const char **bases = (const char **) basenames->data;
+		const char **dirs = (const char **) dirnames->data;
+		const uint32_t *indexes = (const uint32_t *) dirindexes->data;
+		rpm_count_t count = rpmtdCount (basenames);
+
+		files.reserve (count);
+		for (rpm_count_t i = 0; i < count && i < rpmtdCount (dirindexes); i++) {
+			if (indexes[i] < rpmtdCount (dirnames))
+				files.add (dirs[indexes[i]], bases[i]);
+		}
+	}
+
+	rpmtdFreeData (basenames);
+	rpmtdFreeData (dirnames);
+	rpmtdFreeData (dirindexes);
+	rpmtdFree (basenames);
+	rpmtdFree (dirnames);
+	rpmtdFree (dirindexes);
+}
+
 static void
 backend_get_files_thread (PkBackendJob *job, GVariant *params, gpointer user_data)
 {
@@ -3052,8 +3685,11 @@ backend_get_files_thread (PkBackendJob *job, GVariant *params, gpointer user_dat
 		return;
 	}
 
+	// one iterator over the rpm database for all the packages
+	target::rpm::librpmDb::db_const_iterator rpmdb;
+
+	pk_backend_job_set_status (job, PK_STATUS_ENUM_QUERY);
 	for (uint i = 0; package_ids[i]; i++) {
-		pk_backend_job_set_status (job, PK_STATUS_ENUM_QUERY);
 		sat::Solvable solvable = zypp_get_package_by_id (package_ids[i]);
 		
 		if (zypp_is_no_solvable(solvable)) {
@@ -3063,29 +3699,23 @@ backend_get_files_thread (PkBackendJob *job, GVariant *params, gpointer user_dat
 			return;
 		}
 
-		string temp;
+		FilesEmitter files (job, package_ids[i]);
 		if (solvable.isSystem ()){
 			try {
-				target::rpm::RpmHeader::constPtr rpmHeader = zypp_get_rpmHeader (solvable.name (), solvable.edition ());
-				list<string> files = rpmHeader->tag_filenames ();
-
-				for (list<string>::iterator it = files.begin (); it != files.end (); ++it) {
-					temp.append (*it);
-					temp.append (";");
-				}
-
+				target::rpm::RpmHeader::constPtr rpmHeader = zypp_get_rpmHeader (rpmdb, solvable.name (), solvable.edition ());
+				zypp_add_header_files (files, rpmHeader);
 			} catch (const target::rpm::RpmException &ex) {
 				zypp_backend_finished_error (job, PK_ERROR_ENUM_REPO_NOT_FOUND,
 							     "Couldn't open rpm-database");
 				return;
 			}
 		} else {
-			temp = "Only available for installed packages";
+			// the file list from the repository metadata
+			sat::LookupAttr filelist (sat::SolvAttr::filelist, solvable);
+			for (sat::LookupAttr::iterator it = filelist.begin (); it != filelist.end (); ++it)
+				files.add (it.c_str ());
 		}
-
-		const gchar *to_strv[] = { NULL, NULL };
-		to_strv[0] = temp.c_str ();
-		pk_backend_job_files (job, package_ids[i], (gchar **) to_strv);	// file_list
+		files.emit ();
 	}
 
 	pk_backend_job_finished (job);
@@ -3109,7 +3739,7 @@ backend_get_packages_thread (PkBackendJob *job, GVariant *params, gpointer user_
 	g_variant_get (params, "(t)",
 		       &_filters);
 
-	ZyppJob zjob(job);
+	ZyppJob zjob(job, TRUE);
 	ZYpp::Ptr zypp = zjob.get_zypp();
 
 	if (zypp == NULL){
@@ -3118,12 +3748,17 @@ backend_get_packages_thread (PkBackendJob *job, GVariant *params, gpointer user_
 	}
 	pk_backend_job_set_status (job, PK_STATUS_ENUM_QUERY);
 
-	vector<sat::Solvable> v;
+	if (!zjob.is_shared ())
+		zypp_build_pool (zypp, TRUE);
+	zjob.share ();
 
-	zypp_build_pool (zypp, TRUE);
-	ResPool pool = ResPool::instance ();
-	for (ResPool::byKind_iterator it = pool.byKindBegin (ResKind::package); it != pool.byKindEnd (ResKind::package); ++it) {
-		v.push_back (it->satSolvable ());
+	vector<sat::Solvable> v;
+	{
+		ZyppPoolLock lock;
+		ResPool pool = ResPool::instance ();
+		for (ResPool::byKind_iterator it = pool.byKindBegin (ResKind::package); it != pool.byKindEnd (ResKind::package); ++it) {
+			v.push_back (it->satSolvable ());
+		}
 	}
 
 	zypp_emit_filtered_packages_in_list (job, _filters, v);
@@ -3379,7 +4014,10 @@ backend_what_provides_thread (PkBackendJob *job, GVariant *params, gpointer user
 		      &_filters,
 		      &values);
 	
-	ZyppJob zjob(job);
+	// the solver run changes the status of the pool
+	gboolean drivers = g_ascii_strcasecmp("drivers_for_attached_hardware", values[0]) == 0;
+
+	ZyppJob zjob(job, !drivers);
 	ZYpp::Ptr zypp = zjob.get_zypp();
 
 	if (zypp == NULL){
@@ -3388,9 +4026,11 @@ backend_what_provides_thread (PkBackendJob *job, GVariant *params, gpointer user
 	}
 	pk_backend_job_set_status (job, PK_STATUS_ENUM_QUERY);
 
-	ResPool pool = zypp_build_pool (zypp, true);
+	if (!zjob.is_shared ())
+		zypp_build_pool (zypp, true);
+	ResPool pool = ResPool::instance ();
 
-	if(g_ascii_strcasecmp("drivers_for_attached_hardware", values[0]) == 0) {
+	if (drivers) {
 		// solver run
 		Resolver solver(pool);
 		solver.setIgnoreAlreadyRecommended (TRUE);
@@ -3431,19 +4071,30 @@ backend_what_provides_thread (PkBackendJob *job, GVariant *params, gpointer user
 		GHashTable *installed_hash = g_hash_table_new (g_str_hash, g_str_equal);
 		
 		guint len = g_strv_length (search);
+
+		// parsing the capabilities adds them to the pool
+		vector< vector<sat::Solvable> > providers (len);
 		for (guint i=0; i<len; i++) {
 			MIL << search[i] << endl;
 			Capability cap (search[i]);
 			sat::WhatProvides prov (cap);
+			providers[i].assign (prov.begin (), prov.end ());
+		}
+		zjob.share ();
+
+		for (guint i=0; i<len; i++) {
+			const vector<sat::Solvable> &prov = providers[i];
 			
-			for (sat::WhatProvides::const_iterator it = prov.begin (); it != prov.end (); ++it) {
+			for (vector<sat::Solvable>::const_iterator it = prov.begin (); it != prov.end (); ++it) {
+				ZyppPoolLock lock;
 				if (it->isSystem ())
 					g_hash_table_insert (installed_hash,
 							     (const gpointer) make<ResObject>(*it)->summary().c_str (),
 							     GUINT_TO_POINTER (1));
 			}
 
-			for (sat::WhatProvides::const_iterator it = prov.begin (); it != prov.end (); ++it) {
+			for (vector<sat::Solvable>::const_iterator it = prov.begin (); it != prov.end (); ++it) {
+				ZyppPoolLock lock;
 				if (zypp_filter_solvable (_filters, *it))
 					continue;
 
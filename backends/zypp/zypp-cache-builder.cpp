@@ -0,0 +1,111 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2014 PackageKit contributors
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+
+#include <zypp/base/Logger.h>
+
+#include "zypp-cache-builder.h"
+
+using namespace std;
+using namespace zypp;
+
+#undef ZYPP_BASE_LOGGER_LOGGROUP
+#define ZYPP_BASE_LOGGER_LOGGROUP "packagekit"
+
+struct ZyppCacheBuilder::Item {
+	RepoInfo repo;
+	bool force;
+	string error;
+};
+
+ZyppCacheBuilder::ZyppCacheBuilder(const RepoManagerOptions &options, gint max_parallel)
+	: _options(options), _pending(0)
+{
+	_done = g_async_queue_new ();
+	_workers = g_thread_pool_new (build_thread, this,
+				      MAX (max_parallel, 1), FALSE, NULL);
+}
+
+ZyppCacheBuilder::~ZyppCacheBuilder()
+{
+	RepoInfo repo;
+	string error;
+
+	// the builds can't be interrupted, wait for them
+	while (next (repo, error, true))
+		;
+	g_thread_pool_free (_workers, FALSE, TRUE);
+	g_async_queue_unref (_done);
+}
+
+/**
+ * Build the cache of one repository, in a worker thread
+ */
+void
+ZyppCacheBuilder::build_thread(gpointer data, gpointer user_data)
+{
+	Item *item = (Item *) data;
+	ZyppCacheBuilder *builder = (ZyppCacheBuilder *) user_data;
+
+	try {
+		RepoManager manager (builder->_options);
+		manager.buildCache (item->repo, item->force ? RepoManager::BuildForced :
+							      RepoManager::BuildIfNeeded);
+	} catch (const Exception &ex) {
+		item->error = ex.asUserString ();
+	}
+
+	g_async_queue_push (builder->_done, item);
+}
+
+void
+ZyppCacheBuilder::add(const RepoInfo &repo, bool force)
+{
+	Item *item = new Item;
+	item->repo = repo;
+	item->force = force;
+	_pending++;
+
+	MIL << "building the cache of " << repo.alias () << endl;
+	g_thread_pool_push (_workers, item, NULL);
+}
+
+bool
+ZyppCacheBuilder::next(RepoInfo &repo, string &error, bool block)
+{
+	Item *item;
+
+	if (_pending == 0)
+		return false;
+	if (block)
+		item = (Item *) g_async_queue_pop (_done);
+	else
+		item = (Item *) g_async_queue_try_pop (_done);
+	if (item == NULL)
+		return false;
+	_pending--;
+
+	repo = item->repo;
+	error = item->error;
+	delete item;
+	return true;
+}
@@ -0,0 +1,66 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2014 PackageKit contributors
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __ZYPP_CACHE_BUILDER_H
+#define __ZYPP_CACHE_BUILDER_H
+
+#include <string>
+#include <glib.h>
+
+#include <zypp/RepoInfo.h>
+#include <zypp/RepoManager.h>
+
+/// \class ZyppCacheBuilder
+/// \brief Builds the solv caches of several repositories at once.
+///
+/// Each cache is built by RepoManager::buildCache() in a worker thread,
+/// at most max_parallel at a time. The workers don't share anything with
+/// each other or with the thread calling add() and next(): every one uses
+/// a RepoManager of its own, and only touches the cache of the repository
+/// it builds.
+class ZyppCacheBuilder {
+ public:
+	ZyppCacheBuilder(const zypp::RepoManagerOptions &options, gint max_parallel);
+	~ZyppCacheBuilder();
+
+	/// Starts building the cache of the repository. Caches that are
+	/// up to date are not built again unless force is set.
+	void add(const zypp::RepoInfo &repo, bool force);
+
+	/// Gets a repository whose cache is done, waiting for one if block
+	/// is set. error is empty if the cache was built.
+	/// \returns false if there was none
+	bool next(zypp::RepoInfo &repo, std::string &error, bool block);
+
+	/// The repositories added that next() did not return yet
+	guint pending() const { return _pending; }
+
+ private:
+	struct Item;
+	static void build_thread(gpointer data, gpointer user_data);
+
+	zypp::RepoManagerOptions _options;
+	GThreadPool *_workers;
+	GAsyncQueue *_done;
+	guint _pending;
+};
+
+#endif /* __ZYPP_CACHE_BUILDER_H */
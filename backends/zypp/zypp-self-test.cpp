@@ -0,0 +1,218 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2014 PackageKit contributors
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <zypp/PathInfo.h>
+#include <zypp/RepoInfo.h>
+#include <zypp/RepoManager.h>
+#include <zypp/Repository.h>
+#include <zypp/Url.h>
+#include <zypp/sat/Pool.h>
+
+#include "zypp-cache-builder.h"
+
+using namespace std;
+using namespace zypp;
+
+#define ZYPP_TEST_REPOS		5
+
+static const gchar *zypp_test_primary =
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	"<metadata xmlns=\"http://linux.duke.edu/metadata/common\" "
+	"xmlns:rpm=\"http://linux.duke.edu/metadata/rpm\" packages=\"1\">\n"
+	"<package type=\"rpm\">\n"
+	"  <name>%s</name>\n"
+	"  <arch>noarch</arch>\n"
+	"  <version epoch=\"0\" ver=\"1.0\" rel=\"1\"/>\n"
+	"  <checksum type=\"sha256\" pkgid=\"YES\">%s</checksum>\n"
+	"  <summary>Test package</summary>\n"
+	"  <description>Test package</description>\n"
+	"  <packager/>\n"
+	"  <url/>\n"
+	"  <time file=\"1\" build=\"1\"/>\n"
+	"  <size package=\"1\" installed=\"1\" archive=\"1\"/>\n"
+	"  <location href=\"%s-1.0-1.noarch.rpm\"/>\n"
+	"  <format>\n"
+	"    <rpm:license>GPL</rpm:license>\n"
+	"    <rpm:group>Misc</rpm:group>\n"
+	"    <rpm:provides>\n"
+	"      <rpm:entry name=\"%s\" flags=\"EQ\" epoch=\"0\" ver=\"1.0\" rel=\"1\"/>\n"
+	"    </rpm:provides>\n"
+	"  </format>\n"
+	"</package>\n"
+	"</metadata>\n";
+
+static const gchar *zypp_test_repomd =
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	"<repomd xmlns=\"http://linux.duke.edu/metadata/repo\">\n"
+	"  <data type=\"primary\">\n"
+	"    <checksum type=\"sha256\">%s</checksum>\n"
+	"    <open-checksum type=\"sha256\">%s</open-checksum>\n"
+	"    <location href=\"repodata/primary.xml\"/>\n"
+	"    <timestamp>1</timestamp>\n"
+	"  </data>\n"
+	"</repomd>\n";
+
+/**
+ * zypp_test_write_repo:
+ *
+ * Writes a rpm-md repository with a single package to @path
+ **/
+static void
+zypp_test_write_repo (const gchar *path, const gchar *name)
+{
+	gboolean ret;
+	gchar *checksum;
+	gchar *filename;
+	gchar *pkgid;
+	gchar *primary;
+	gchar *repodata;
+	gchar *repomd;
+	GError *error = NULL;
+
+	repodata = g_build_filename (path, "repodata", NULL);
+	g_assert_cmpint (g_mkdir_with_parents (repodata, 0755), ==, 0);
+
+	pkgid = g_compute_checksum_for_string (G_CHECKSUM_SHA256, name, -1);
+	primary = g_strdup_printf (zypp_test_primary, name, pkgid, name, name);
+	filename = g_build_filename (repodata, "primary.xml", NULL);
+	ret = g_file_set_contents (filename, primary, -1, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_free (filename);
+
+	checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA256, primary, -1);
+	repomd = g_strdup_printf (zypp_test_repomd, checksum, checksum);
+	filename = g_build_filename (repodata, "repomd.xml", NULL);
+	ret = g_file_set_contents (filename, repomd, -1, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_free (filename);
+
+	g_free (checksum);
+	g_free (pkgid);
+	g_free (primary);
+	g_free (repodata);
+	g_free (repomd);
+}
+
+static void
+zypp_test_cache_builder_func (void)
+{
+	gchar *tmp;
+	guint built = 0;
+	guint i;
+	GError *error = NULL;
+	RepoInfo repo;
+	string message;
+	vector<RepoInfo> repos;
+
+	/* libzypp builds the caches with repo2solv.sh */
+	tmp = g_find_program_in_path ("repo2solv.sh");
+	if (tmp == NULL)
+		return;
+	g_free (tmp);
+
+	tmp = g_dir_make_tmp ("zypp-self-test-XXXXXX", &error);
+	g_assert_no_error (error);
+	g_assert (tmp != NULL);
+
+	/* a few local repositories, refreshed over file:// */
+	filesystem::Pathname root (tmp);
+	RepoManagerOptions options (root / "root");
+	RepoManager manager (options);
+	for (i = 0; i < ZYPP_TEST_REPOS; i++) {
+		gchar *name = g_strdup_printf ("test%i", i);
+		gchar *path = g_build_filename (tmp, "repos", name, NULL);
+		zypp_test_write_repo (path, name);
+
+		RepoInfo info;
+		info.setAlias (name);
+		info.setName (name);
+		info.setType (repo::RepoType::RPMMD);
+		info.addBaseUrl (Url (string ("file://") + path));
+		info.setEnabled (true);
+		info.setAutorefresh (true);
+		info.setGpgCheck (false);
+		manager.addRepository (info);
+		manager.refreshMetadata (info, RepoManager::RefreshForced);
+		repos.push_back (info);
+
+		g_free (name);
+		g_free (path);
+	}
+
+	/* build all the caches, two at a time */
+	{
+		ZyppCacheBuilder builder (options, 2);
+		for (i = 0; i < repos.size (); i++)
+			builder.add (repos[i], false);
+		g_assert_cmpint (builder.pending (), ==, ZYPP_TEST_REPOS);
+
+		while (builder.next (repo, message, true)) {
+			g_assert_cmpstr (message.c_str (), ==, "");
+			g_assert (manager.isCached (repo));
+			built++;
+		}
+		g_assert_cmpint (built, ==, ZYPP_TEST_REPOS);
+		g_assert_cmpint (builder.pending (), ==, 0);
+	}
+
+	/* the cookies match the metadata, and the caches can be loaded */
+	for (i = 0; i < repos.size (); i++) {
+		g_assert_cmpstr (manager.cacheStatus (repos[i]).checksum ().c_str (), ==,
+				 manager.metadataStatus (repos[i]).checksum ().c_str ());
+		manager.loadFromCache (repos[i]);
+		Repository loaded = sat::Pool::instance ().reposFind (repos[i].alias ());
+		g_assert_cmpint (loaded.solvablesSize (), ==, 1);
+	}
+
+	/* nothing to do when the caches are up to date */
+	{
+		ZyppCacheBuilder builder (options, 2);
+		for (i = 0; i < repos.size (); i++)
+			builder.add (repos[i], false);
+		built = 0;
+		while (builder.next (repo, message, false)) {
+			g_assert_cmpstr (message.c_str (), ==, "");
+			built++;
+		}
+		g_assert_cmpint (built, ==, ZYPP_TEST_REPOS);
+	}
+
+	sat::Pool::instance ().reposEraseAll ();
+	filesystem::recursive_rmdir (root);
+	g_free (tmp);
+}
+
+int
+main (int argc, char **argv)
+{
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/zypp/cache-builder", zypp_test_cache_builder_func);
+
+	return g_test_run ();
+}
@@ -0,0 +1,12 @@
+#!/bin/sh
+# Copyright (C) 2014 PackageKit contributors
+# Licensed under the GNU General Public License Version 2
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+
+# more output than one read gets, written in buffer sized
+# chunks so most of the lines are split over two reads
+seq 1 1000 | sed 's/^/package\tavailable\tpolkit;0.0.1;i386;data\tPolicyKit daemon /'
+
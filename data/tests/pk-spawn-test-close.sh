@@ -0,0 +1,14 @@
+#!/bin/sh
+# Copyright (C) 2014 PackageKit contributors
+# Licensed under the GNU General Public License Version 2
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+
+echo -e "percentage\t0"
+
+# close stdout, but only exit a while later
+exec >&-
+sleep 1
+
@@ -1121,6 +1121,7 @@ pk_client_signal_cb (GDBusProxy *proxy,
 	guint tmp_uint;
 	guint tmp_uint2;
 	guint tmp_uint3;
+	GVariantIter *tmp_iter;
 
 	if (g_strcmp0 (signal_name, "Finished") == 0) {
 		g_variant_get (parameters,
@@ -1144,6 +1145,20 @@ pk_client_signal_cb (GDBusProxy *proxy,
 					  tmp_str[2]);
 		return;
 	}
+	if (g_strcmp0 (signal_name, "Packages") == 0) {
+		g_variant_get (parameters, "(a(uss))", &tmp_iter);
+		while (g_variant_iter_loop (tmp_iter, "(u&s&s)",
+					    &tmp_uint,
+					    &tmp_str[1],
+					    &tmp_str[2])) {
+			pk_client_signal_package (state,
+						  tmp_uint,
+						  tmp_str[1],
+						  tmp_str[2]);
+		}
+		g_variant_iter_free (tmp_iter);
+		return;
+	}
 	if (g_strcmp0 (signal_name, "Details") == 0) {
 		gchar *key;
 		GVariantIter *dictionary;
@@ -2126,6 +2141,10 @@ pk_client_get_proxy_cb (GObject *object,
 		g_ptr_array_add (array, hint);
 	}
 
+	/* we can take many packages in one signal */
+	hint = g_strdup ("packages-signal=true");
+	g_ptr_array_add (array, hint);
+
 	/* create socket for roles that need interaction */
 	if (state->role == PK_ROLE_ENUM_INSTALL_FILES ||
 	    state->role == PK_ROLE_ENUM_INSTALL_PACKAGES ||
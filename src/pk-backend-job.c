@@ -111,10 +111,53 @@ struct PkBackendJobPrivate
 	PkStatusEnum		 status;
 	PkTime			*time;
 	gboolean		 started;
+	GSList			*packages_queue;
+	GSList			*packages_pending;
+	gint			 packages_scheduled;
+	gint			 signals_scheduled;
+	gint			 serial;
 };
 
+/* the most packages handed to the PK_BACKEND_SIGNAL_PACKAGES vfunc at once */
+#define PK_BACKEND_JOB_PACKAGES_CHUNK	1000
+
+/* a package waiting to be handed to the PK_BACKEND_SIGNAL_PACKAGES vfunc */
+typedef struct {
+	PkPackage		*package;
+	guint			 serial;
+} PkBackendJobQueuedPackage;
+
 G_DEFINE_TYPE (PkBackendJob, pk_backend_job, G_TYPE_OBJECT)
 
+/**
+ * pk_backend_job_queued_package_free:
+ **/
+static void
+pk_backend_job_queued_package_free (PkBackendJobQueuedPackage *queued)
+{
+	g_object_unref (queued->package);
+	g_free (queued);
+}
+
+/**
+ * pk_backend_job_packages_clear:
+ **/
+static void
+pk_backend_job_packages_clear (PkBackendJob *job)
+{
+	GSList *queue;
+
+	queue = g_atomic_pointer_get (&job->priv->packages_queue);
+	while (!g_atomic_pointer_compare_and_exchange (&job->priv->packages_queue,
+						       queue, NULL))
+		queue = g_atomic_pointer_get (&job->priv->packages_queue);
+	g_slist_free_full (queue,
+			   (GDestroyNotify) pk_backend_job_queued_package_free);
+	g_slist_free_full (job->priv->packages_pending,
+			   (GDestroyNotify) pk_backend_job_queued_package_free);
+	job->priv->packages_pending = NULL;
+}
+
 /**
  * pk_backend_job_reset:
  **/
@@ -132,6 +175,9 @@ pk_backend_job_reset (PkBackendJob *job)
 	job->priv->role = PK_ROLE_ENUM_UNKNOWN;
 	job->priv->status = PK_STATUS_ENUM_UNKNOWN;
 
+	/* drop packages the last job never got to deliver */
+	pk_backend_job_packages_clear (job);
+
 	/* reset the vfuncs too */
 	for (i = 0; i < PK_BACKEND_SIGNAL_LAST; i++) {
 		item = &job->priv->vfunc_items[i];
@@ -578,6 +624,7 @@ typedef struct {
 	PkBackendJobSignal	 signal_kind;
 	GObject			*object;
 	GDestroyNotify		 destroy_func;
+	guint			 serial;
 } PkBackendJobVFuncHelper;
 
 /**
@@ -628,9 +675,140 @@ pk_backend_job_signal_to_string (PkBackendJobSignal id)
 		return "UpdateDetail";
 	if (id == PK_BACKEND_SIGNAL_CATEGORY)
 		return "Category";
+	if (id == PK_BACKEND_SIGNAL_PACKAGES)
+		return "Packages";
 	return NULL;
 }
 
+/**
+ * pk_backend_job_packages_flush:
+ * @limit: the serial of the first package not to deliver
+ *
+ * Hands the packages queued by pk_backend_job_package() before @limit
+ * to the PK_BACKEND_SIGNAL_PACKAGES vfunc, in order and in chunks.
+ * Must be called in the main thread.
+ **/
+static void
+pk_backend_job_packages_flush (PkBackendJob *job, guint limit)
+{
+	GPtrArray *array;
+	GSList *keep = NULL;
+	GSList *l;
+	GSList *queue;
+	PkBackendJobQueuedPackage *queued;
+	PkBackendJobVFuncItem *item;
+
+	/* take the whole queue, the backend thread can keep pushing */
+	do {
+		queue = g_atomic_pointer_get (&job->priv->packages_queue);
+	} while (!g_atomic_pointer_compare_and_exchange (&job->priv->packages_queue,
+							 queue, NULL));
+
+	/* the queue is newest-first, and newer than anything held back */
+	job->priv->packages_pending = g_slist_concat (job->priv->packages_pending,
+						      g_slist_reverse (queue));
+	if (job->priv->packages_pending == NULL)
+		return;
+
+	item = &job->priv->vfunc_items[PK_BACKEND_SIGNAL_PACKAGES];
+	array = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	for (l = job->priv->packages_pending; l != NULL; l = l->next) {
+		queued = l->data;
+
+		/* emitted after the signal we are about to deliver */
+		if (queued->serial >= limit) {
+			keep = g_slist_prepend (keep, queued);
+			continue;
+		}
+		g_ptr_array_add (array, queued->package);
+		g_free (queued);
+		if (array->len < PK_BACKEND_JOB_PACKAGES_CHUNK)
+			continue;
+		if (item->vfunc != NULL) {
+			item->vfunc (job, (gpointer) array, item->user_data);
+		} else {
+			g_warning ("tried to do signal %s when no longer connected",
+				   pk_backend_job_signal_to_string (PK_BACKEND_SIGNAL_PACKAGES));
+		}
+		g_ptr_array_set_size (array, 0);
+	}
+	if (array->len > 0) {
+		if (item->vfunc != NULL) {
+			item->vfunc (job, (gpointer) array, item->user_data);
+		} else {
+			g_warning ("tried to do signal %s when no longer connected",
+				   pk_backend_job_signal_to_string (PK_BACKEND_SIGNAL_PACKAGES));
+		}
+	}
+	g_ptr_array_unref (array);
+	g_slist_free (job->priv->packages_pending);
+	job->priv->packages_pending = g_slist_reverse (keep);
+}
+
+/**
+ * pk_backend_job_packages_flush_unblocked:
+ *
+ * Delivers the queued packages unless a signal emitted before some of
+ * them is still waiting, in which case its idle handler does it.
+ **/
+static void
+pk_backend_job_packages_flush_unblocked (PkBackendJob *job)
+{
+	guint limit;
+
+	/* anything queued after this gets a new idle */
+	g_atomic_int_set (&job->priv->packages_scheduled, 0);
+
+	/* signals take their serial after being counted, so none older
+	 * than the limit can be missed here */
+	limit = g_atomic_int_get (&job->priv->serial);
+	if (g_atomic_int_get (&job->priv->signals_scheduled) > 0)
+		return;
+	pk_backend_job_packages_flush (job, limit);
+}
+
+/**
+ * pk_backend_job_packages_idle_cb:
+ **/
+static gboolean
+pk_backend_job_packages_idle_cb (gpointer user_data)
+{
+	PkBackendJob *job = PK_BACKEND_JOB (user_data);
+	pk_backend_job_packages_flush_unblocked (job);
+	return FALSE;
+}
+
+/**
+ * pk_backend_job_packages_push:
+ *
+ * This method can be called in any thread, the package is delivered
+ * after the signals and packages emitted before it.
+ **/
+static void
+pk_backend_job_packages_push (PkBackendJob *job, PkPackage *item)
+{
+	GSList *node;
+	PkBackendJobQueuedPackage *queued;
+
+	queued = g_new0 (PkBackendJobQueuedPackage, 1);
+	queued->package = g_object_ref (item);
+	queued->serial = g_atomic_int_add (&job->priv->serial, 1);
+	node = g_slist_alloc ();
+	node->data = queued;
+	do {
+		node->next = g_atomic_pointer_get (&job->priv->packages_queue);
+	} while (!g_atomic_pointer_compare_and_exchange (&job->priv->packages_queue,
+							 node->next, node));
+
+	/* only the first package since the last flush schedules one */
+	if (g_atomic_int_compare_and_exchange (&job->priv->packages_scheduled, 0, 1)) {
+		g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+				 pk_backend_job_packages_idle_cb,
+				 g_object_ref (job),
+				 g_object_unref);
+	}
+}
+
 /**
  * pk_backend_job_call_vfunc_idle_cb:
  **/
@@ -640,6 +818,9 @@ pk_backend_job_call_vfunc_idle_cb (gpointer user_data)
 	PkBackendJobVFuncHelper *helper = (PkBackendJobVFuncHelper *) user_data;
 	PkBackendJobVFuncItem *item;
 
+	/* packages emitted before this signal have to arrive first */
+	pk_backend_job_packages_flush (helper->job, helper->serial);
+
 	/* call transaction vfunc on main thread */
 	item = &helper->job->priv->vfunc_items[helper->signal_kind];
 	if (item != NULL && item->vfunc != NULL) {
@@ -652,6 +833,10 @@ pk_backend_job_call_vfunc_idle_cb (gpointer user_data)
 	}
 	if (helper->destroy_func != NULL)
 		helper->destroy_func (helper->object);
+
+	/* the packages emitted after it may have been held back for it */
+	g_atomic_int_add (&helper->job->priv->signals_scheduled, -1);
+	pk_backend_job_packages_flush_unblocked (helper->job);
 	return FALSE;
 }
 
@@ -685,6 +870,8 @@ pk_backend_job_call_vfunc (PkBackendJob *job,
 	helper->signal_kind = signal_kind;
 	helper->object = object;
 	helper->destroy_func = destroy_func;
+	g_atomic_int_inc (&job->priv->signals_scheduled);
+	helper->serial = g_atomic_int_add (&job->priv->serial, 1);
 	g_idle_add_full (priority,
 			 pk_backend_job_call_vfunc_idle_cb,
 			 helper,
@@ -1129,7 +1316,11 @@ pk_backend_job_package (PkBackendJob *job,
 	/* we've sent a package for this transaction */
 	job->priv->has_sent_package = TRUE;
 
-	/* emit */
+	/* emit many at once if the transaction can take them */
+	if (pk_backend_job_get_vfunc_enabled (job, PK_BACKEND_SIGNAL_PACKAGES)) {
+		pk_backend_job_packages_push (job, item);
+		goto out;
+	}
 	pk_backend_job_call_vfunc (job,
 				   PK_BACKEND_SIGNAL_PACKAGE,
 				   g_object_ref (item),
@@ -1929,6 +2120,7 @@ pk_backend_job_finalize (GObject *object)
 		g_object_unref (job->priv->last_package);
 		job->priv->last_package = NULL;
 	}
+	pk_backend_job_packages_clear (job);
 	if (job->priv->params != NULL)
 		g_variant_unref (job->priv->params);
 	g_object_unref (job->priv->time);
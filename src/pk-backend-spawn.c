@@ -55,6 +55,10 @@
 
 #define	PK_UNSAFE_DELIMITERS	"\\\f\r\t"
 
+/* lines and field lists up to these sizes are parsed without allocating */
+#define PK_BACKEND_SPAWN_LINE_STACK	1024
+#define PK_BACKEND_SPAWN_FIELDS_STACK	16
+
 struct PkBackendSpawnPrivate
 {
 	PkSpawn			*spawn;
@@ -152,6 +156,136 @@ pk_backend_spawn_start_kill_timer (PkBackendSpawn *backend_spawn)
 	g_source_set_name_by_id (priv->kill_id, "[PkBackendSpawn] exit");
 }
 
+/* the commands a spawned backend can send on stdout */
+typedef enum {
+	PK_BACKEND_SPAWN_COMMAND_UNKNOWN,
+	PK_BACKEND_SPAWN_COMMAND_PACKAGE,
+	PK_BACKEND_SPAWN_COMMAND_DETAILS,
+	PK_BACKEND_SPAWN_COMMAND_FINISHED,
+	PK_BACKEND_SPAWN_COMMAND_FILES,
+	PK_BACKEND_SPAWN_COMMAND_REPO_DETAIL,
+	PK_BACKEND_SPAWN_COMMAND_UPDATE_DETAIL,
+	PK_BACKEND_SPAWN_COMMAND_PERCENTAGE,
+	PK_BACKEND_SPAWN_COMMAND_ITEM_PROGRESS,
+	PK_BACKEND_SPAWN_COMMAND_ERROR,
+	PK_BACKEND_SPAWN_COMMAND_REQUIRE_RESTART,
+	PK_BACKEND_SPAWN_COMMAND_STATUS,
+	PK_BACKEND_SPAWN_COMMAND_SPEED,
+	PK_BACKEND_SPAWN_COMMAND_DOWNLOAD_SIZE_REMAINING,
+	PK_BACKEND_SPAWN_COMMAND_ALLOW_CANCEL,
+	PK_BACKEND_SPAWN_COMMAND_NO_PERCENTAGE_UPDATES,
+	PK_BACKEND_SPAWN_COMMAND_REPO_SIGNATURE_REQUIRED,
+	PK_BACKEND_SPAWN_COMMAND_EULA_REQUIRED,
+	PK_BACKEND_SPAWN_COMMAND_MEDIA_CHANGE_REQUIRED,
+	PK_BACKEND_SPAWN_COMMAND_DISTRO_UPGRADE,
+	PK_BACKEND_SPAWN_COMMAND_CATEGORY
+} PkBackendSpawnCommand;
+
+typedef struct {
+	const gchar		*verb;
+	PkBackendSpawnCommand	 command;
+	guint			 size_min;
+	guint			 size_max;
+} PkBackendSpawnVerb;
+
+/* indexed by PK_BACKEND_SPAWN_VERB_HASH, which has no collisions for these
+ * verbs, so a lookup is one hash and one string compare */
+#define PK_BACKEND_SPAWN_VERB_HASH(verb, len)	(((len) + 2 * (guchar) (verb)[0] + (guchar) (verb)[(len) - 2]) & 63)
+static const PkBackendSpawnVerb pk_backend_spawn_verbs[64] = {
+	[0]  = { "category",			PK_BACKEND_SPAWN_COMMAND_CATEGORY,			6, 6 },
+	[13] = { "download-size-remaining",	PK_BACKEND_SPAWN_COMMAND_DOWNLOAD_SIZE_REMAINING,	2, 2 },
+	[14] = { "package",			PK_BACKEND_SPAWN_COMMAND_PACKAGE,			4, 4 },
+	[16] = { "speed",			PK_BACKEND_SPAWN_COMMAND_SPEED,				2, 2 },
+	[17] = { "percentage",			PK_BACKEND_SPAWN_COMMAND_PERCENTAGE,			2, 2 },
+	[18] = { "item-progress",		PK_BACKEND_SPAWN_COMMAND_ITEM_PROGRESS,			4, 4 },
+	[20] = { "media-change-required",	PK_BACKEND_SPAWN_COMMAND_MEDIA_CHANGE_REQUIRED,		4, 4 },
+	[22] = { "no-percentage-updates",	PK_BACKEND_SPAWN_COMMAND_NO_PERCENTAGE_UPDATES,		1, 1 },
+	[24] = { "repo-detail",			PK_BACKEND_SPAWN_COMMAND_REPO_DETAIL,			4, 4 },
+	[31] = { "updatedetail",		PK_BACKEND_SPAWN_COMMAND_UPDATE_DETAIL,			13, 13 },
+	[32] = { "repo-signature-required",	PK_BACKEND_SPAWN_COMMAND_REPO_SIGNATURE_REQUIRED,	9, 9 },
+	[33] = { "status",			PK_BACKEND_SPAWN_COMMAND_STATUS,			2, 2 },
+	[36] = { "requirerestart",		PK_BACKEND_SPAWN_COMMAND_REQUIRE_RESTART,		3, 3 },
+	[51] = { "allow-cancel",		PK_BACKEND_SPAWN_COMMAND_ALLOW_CANCEL,			2, 2 },
+	[54] = { "files",			PK_BACKEND_SPAWN_COMMAND_FILES,				3, 3 },
+	[57] = { "finished",			PK_BACKEND_SPAWN_COMMAND_FINISHED,			1, 1 },
+	[58] = { "distro-upgrade",		PK_BACKEND_SPAWN_COMMAND_DISTRO_UPGRADE,		4, 4 },
+	[59] = { "details",			PK_BACKEND_SPAWN_COMMAND_DETAILS,			7, 8 },
+	[60] = { "eula-required",		PK_BACKEND_SPAWN_COMMAND_EULA_REQUIRED,			5, 5 },
+	[62] = { "error",			PK_BACKEND_SPAWN_COMMAND_ERROR,				3, 3 },
+};
+
+/**
+ * pk_backend_spawn_verb_lookup:
+ **/
+static const PkBackendSpawnVerb *
+pk_backend_spawn_verb_lookup (const gchar *command)
+{
+	const PkBackendSpawnVerb *verb;
+	gsize len;
+
+	len = strlen (command);
+	if (len < 2)
+		return NULL;
+	verb = &pk_backend_spawn_verbs[PK_BACKEND_SPAWN_VERB_HASH (command, len)];
+	if (verb->verb == NULL || strcmp (verb->verb, command) != 0)
+		return NULL;
+	return verb;
+}
+
+/* a string split in place, the pointers are on the stack unless there are lots */
+typedef struct {
+	gchar			**strv;
+	guint			 len;
+	gchar			*stack[PK_BACKEND_SPAWN_FIELDS_STACK];
+} PkBackendSpawnFields;
+
+/**
+ * pk_backend_spawn_fields_split:
+ *
+ * Splits @text like g_strsplit() would, but by replacing the delimiters
+ * with NUL bytes, so the fields point into @text.
+ **/
+static void
+pk_backend_spawn_fields_split (PkBackendSpawnFields *fields, gchar *text, gchar delimiter)
+{
+	gchar *tmp;
+	guint i;
+
+	fields->strv = fields->stack;
+	fields->len = 0;
+
+	/* like g_strsplit(), an empty string has no fields */
+	if (text[0] == '\0') {
+		fields->strv[0] = NULL;
+		return;
+	}
+
+	fields->len = 1;
+	for (tmp = strchr (text, delimiter); tmp != NULL; tmp = strchr (tmp + 1, delimiter))
+		fields->len++;
+	if (fields->len >= PK_BACKEND_SPAWN_FIELDS_STACK)
+		fields->strv = g_new (gchar *, fields->len + 1);
+
+	fields->strv[0] = text;
+	for (i = 1; i < fields->len; i++) {
+		tmp = strchr (fields->strv[i - 1], delimiter);
+		*tmp = '\0';
+		fields->strv[i] = tmp + 1;
+	}
+	fields->strv[fields->len] = NULL;
+}
+
+/**
+ * pk_backend_spawn_fields_clear:
+ **/
+static void
+pk_backend_spawn_fields_clear (PkBackendSpawnFields *fields)
+{
+	if (fields->strv != fields->stack)
+		g_free (fields->strv);
+	fields->strv = NULL;
+}
+
 /**
  * pk_backend_spawn_parse_stdout:
  **/
@@ -161,11 +295,14 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 			       const gchar *line,
 			       GError **error)
 {
+	const PkBackendSpawnVerb *verb;
 	gchar **sections;
-	guint size;
 	gchar *command;
-	gchar *text;
+	gchar *copy;
+	gchar copy_stack[PK_BACKEND_SPAWN_LINE_STACK];
+	gchar *copy_heap = NULL;
 	gboolean ret = TRUE;
+	gsize len;
 	guint64 speed;
 	guint64 download_size_remaining;
 	PkInfoEnum info;
@@ -180,6 +317,13 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 	PkUpdateStateEnum update_state_enum;
 	PkMediaTypeEnum media_type_enum;
 	PkDistroUpgradeEnum distro_upgrade_enum;
+	PkBackendSpawnFields fields;
+	PkBackendSpawnFields files;
+	PkBackendSpawnFields updates;
+	PkBackendSpawnFields obsoletes;
+	PkBackendSpawnFields vendor_urls;
+	PkBackendSpawnFields bugzilla_urls;
+	PkBackendSpawnFields cve_urls;
 	PkBackendSpawnPrivate *priv = backend_spawn->priv;
 
 	g_return_val_if_fail (PK_IS_BACKEND_SPAWN (backend_spawn), FALSE);
@@ -188,19 +332,35 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 	if (line == NULL)
 		return FALSE;
 
+	/* work on a copy we can split in place, on the stack if it fits */
+	len = strlen (line);
+	if (len < sizeof (copy_stack)) {
+		memcpy (copy_stack, line, len + 1);
+		copy = copy_stack;
+	} else {
+		copy = copy_heap = g_strdup (line);
+	}
+
 	/* split by tab */
-	sections = g_strsplit (line, "\t", 0);
-	command = sections[0];
+	pk_backend_spawn_fields_split (&fields, copy, '\t');
+	sections = fields.strv;
+	command = fields.len > 0 ? sections[0] : copy;
 
-	/* get size */
-	size = g_strv_length (sections);
+	/* find the verb and check it has the right number of fields */
+	verb = pk_backend_spawn_verb_lookup (command);
+	if (verb == NULL) {
+		g_set_error (error, 1, 0, "invalid command '%s'", command);
+		ret = FALSE;
+		goto out;
+	}
+	if (fields.len < verb->size_min || fields.len > verb->size_max) {
+		g_set_error (error, 1, 0, "invalid command '%s', size %i", command, fields.len);
+		ret = FALSE;
+		goto out;
+	}
 
-	if (g_strcmp0 (command, "package") == 0) {
-		if (size != 4) {
-			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
-			ret = FALSE;
-			goto out;
-		}
+	switch (verb->command) {
+	case PK_BACKEND_SPAWN_COMMAND_PACKAGE:
 		if (pk_package_id_check (sections[2]) == FALSE) {
 			g_set_error_literal (error, 1, 0, "invalid package_id");
 			ret = FALSE;
@@ -222,12 +382,8 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 			goto out;
 		}
 		pk_backend_job_package (job, info, sections[2], sections[3]);
-	} else if (g_strcmp0 (command, "details") == 0) {
-		if (size != 7 && size != 8) {
-			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
-			ret = FALSE;
-			goto out;
-		}
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_DETAILS:
 		group = pk_group_enum_from_string (sections[3]);
 
 		/* ITS4: ignore, checked for overflow */
@@ -246,40 +402,24 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 			ret = FALSE;
 			goto out;
 		}
-		text = g_strdup (sections[4]);
 		/* convert ; to \n as we can't emit them on stdout */
-		g_strdelimit (text, ";", '\n');
-		pk_backend_job_details (job, sections[1], size == 8 ? sections[7] : NULL, sections[2],
-					group, text, sections[5], package_size);
-		g_free (text);
-	} else if (g_strcmp0 (command, "finished") == 0) {
-		if (size != 1) {
-			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
-			ret = FALSE;
-			goto out;
-		}
+		g_strdelimit (sections[4], ";", '\n');
+		pk_backend_job_details (job, sections[1], fields.len == 8 ? sections[7] : NULL, sections[2],
+					group, sections[4], sections[5], package_size);
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_FINISHED:
 		pk_backend_job_finished (job);
 		priv->is_busy = FALSE;
 
 		/* from this point on, we can start the kill timer */
 		pk_backend_spawn_start_kill_timer (backend_spawn);
-
-	} else if (g_strcmp0 (command, "files") == 0) {
-		gchar **tmp;
-		if (size != 3) {
-			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
-			ret = FALSE;
-			goto out;
-		}
-		tmp = g_strsplit (sections[2], ";", -1);
-		pk_backend_job_files (job, sections[1], tmp);
-		g_strfreev (tmp);
-	} else if (g_strcmp0 (command, "repo-detail") == 0) {
-		if (size != 4) {
-			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
-			ret = FALSE;
-			goto out;
-		}
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_FILES:
+		pk_backend_spawn_fields_split (&files, sections[2], ';');
+		pk_backend_job_files (job, sections[1], files.strv);
+		pk_backend_spawn_fields_clear (&files);
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_REPO_DETAIL:
 		g_strdelimit (sections[2], PK_UNSAFE_DELIMITERS, ' ');
 		ret = g_utf8_validate (sections[2], -1, NULL);
 		if (!ret) {
@@ -298,17 +438,8 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 			ret = FALSE;
 			goto out;
 		}
-	} else if (g_strcmp0 (command, "updatedetail") == 0) {
-		gchar **updates;
-		gchar **obsoletes;
-		gchar **vendor_urls;
-		gchar **bugzilla_urls;
-		gchar **cve_urls;
-		if (size != 13) {
-			g_set_error (error, 1, 0, "invalid command '%s', size %i", command, size);
-			ret = FALSE;
-			goto out;
-		}
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_UPDATE_DETAIL:
 		restart = pk_restart_enum_from_string (sections[7]);
 		if (restart == PK_RESTART_ENUM_UNKNOWN) {
 			g_set_error (error, 1, 0, "Restart enum not recognised, and hence ignored: '%s'", sections[7]);
@@ -328,35 +459,31 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 		/* convert ; to \n as we can't emit them on stdout */
 		g_strdelimit (sections[8], ";", '\n');
 		g_strdelimit (sections[9], ";", '\n');
-		updates = g_strsplit (sections[2], "&", -1);
-		obsoletes = g_strsplit (sections[3], "&", -1);
-		vendor_urls = g_strsplit (sections[4], ";", -1);
-		bugzilla_urls = g_strsplit (sections[5], ";", -1);
-		cve_urls = g_strsplit (sections[6], ";", -1);
+		pk_backend_spawn_fields_split (&updates, sections[2], '&');
+		pk_backend_spawn_fields_split (&obsoletes, sections[3], '&');
+		pk_backend_spawn_fields_split (&vendor_urls, sections[4], ';');
+		pk_backend_spawn_fields_split (&bugzilla_urls, sections[5], ';');
+		pk_backend_spawn_fields_split (&cve_urls, sections[6], ';');
 		pk_backend_job_update_detail (job,
 					  sections[1],
-					  updates,
-					  obsoletes,
-					  vendor_urls,
-					  bugzilla_urls,
-					  cve_urls,
+					  updates.strv,
+					  obsoletes.strv,
+					  vendor_urls.strv,
+					  bugzilla_urls.strv,
+					  cve_urls.strv,
 					  restart,
 					  sections[8],
 					  sections[9],
 					  update_state_enum,
 					  sections[11],
 					  sections[12]);
-		g_strfreev (updates);
-		g_strfreev (obsoletes);
-		g_strfreev (vendor_urls);
-		g_strfreev (bugzilla_urls);
-		g_strfreev (cve_urls);
-	} else if (g_strcmp0 (command, "percentage") == 0) {
-		if (size != 2) {
-			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
-			ret = FALSE;
-			goto out;
-		}
+		pk_backend_spawn_fields_clear (&updates);
+		pk_backend_spawn_fields_clear (&obsoletes);
+		pk_backend_spawn_fields_clear (&vendor_urls);
+		pk_backend_spawn_fields_clear (&bugzilla_urls);
+		pk_backend_spawn_fields_clear (&cve_urls);
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_PERCENTAGE:
 		ret = pk_strtoint (sections[1], &percentage);
 		if (!ret) {
 			g_set_error (error, 1, 0, "invalid percentage value %s", sections[1]);
@@ -367,12 +494,8 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 		} else {
 			pk_backend_job_set_percentage (job, percentage);
 		}
-	} else if (g_strcmp0 (command, "item-progress") == 0) {
-		if (size != 4) {
-			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
-			ret = FALSE;
-			goto out;
-		}
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_ITEM_PROGRESS:
 		if (!pk_package_id_check (sections[1])) {
 			g_set_error (error, 1, 0, "invalid package_id");
 			ret = FALSE;
@@ -399,35 +522,23 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 						  sections[1],
 						  status_enum,
 						  percentage);
-	} else if (g_strcmp0 (command, "error") == 0) {
-		if (size != 3) {
-			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
-			ret = FALSE;
-			goto out;
-		}
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_ERROR:
 		error_enum = pk_error_enum_from_string (sections[1]);
 		if (error_enum == PK_ERROR_ENUM_UNKNOWN) {
 			g_set_error (error, 1, 0, "Error enum not recognised, and hence ignored: '%s'", sections[1]);
 			ret = FALSE;
 			goto out;
 		}
-		/* convert back all the ;'s to newlines */
-		text = g_strdup (sections[2]);
-
 		/* convert ; to \n as we can't emit them on stdout */
-		g_strdelimit (text, ";", '\n');
+		g_strdelimit (sections[2], ";", '\n');
 
 		/* convert % else we try to format them */
-		g_strdelimit (text, "%", '$');
+		g_strdelimit (sections[2], "%", '$');
 
-		pk_backend_job_error_code (job, error_enum, "%s", text);
-		g_free (text);
-	} else if (g_strcmp0 (command, "requirerestart") == 0) {
-		if (size != 3) {
-			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
-			ret = FALSE;
-			goto out;
-		}
+		pk_backend_job_error_code (job, error_enum, "%s", sections[2]);
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_REQUIRE_RESTART:
 		restart_enum = pk_restart_enum_from_string (sections[1]);
 		if (restart_enum == PK_RESTART_ENUM_UNKNOWN) {
 			g_set_error (error, 1, 0, "Restart enum not recognised, and hence ignored: '%s'", sections[1]);
@@ -440,12 +551,8 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 			goto out;
 		}
 		pk_backend_job_require_restart (job, restart_enum, sections[2]);
-	} else if (g_strcmp0 (command, "status") == 0) {
-		if (size != 2) {
-			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
-			ret = FALSE;
-			goto out;
-		}
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_STATUS:
 		status_enum = pk_status_enum_from_string (sections[1]);
 		if (status_enum == PK_STATUS_ENUM_UNKNOWN) {
 			g_set_error (error, 1, 0, "Status enum not recognised, and hence ignored: '%s'", sections[1]);
@@ -453,12 +560,8 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 			goto out;
 		}
 		pk_backend_job_set_status (job, status_enum);
-	} else if (g_strcmp0 (command, "speed") == 0) {
-		if (size != 2) {
-			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
-			ret = FALSE;
-			goto out;
-		}
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_SPEED:
 		ret = pk_strtouint64 (sections[1], &speed);
 		if (!ret) {
 			g_set_error (error, 1, 0,
@@ -468,12 +571,8 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 			goto out;
 		}
 		pk_backend_job_set_speed (job, speed);
-	} else if (g_strcmp0 (command, "download-size-remaining") == 0) {
-		if (size != 2) {
-			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
-			ret = FALSE;
-			goto out;
-		}
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_DOWNLOAD_SIZE_REMAINING:
 		ret = pk_strtouint64 (sections[1], &download_size_remaining);
 		if (!ret) {
 			g_set_error (error, 1, 0,
@@ -483,12 +582,8 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 			goto out;
 		}
 		pk_backend_job_set_download_size_remaining (job, download_size_remaining);
-	} else if (g_strcmp0 (command, "allow-cancel") == 0) {
-		if (size != 2) {
-			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
-			ret = FALSE;
-			goto out;
-		}
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_ALLOW_CANCEL:
 		if (g_strcmp0 (sections[1], "true") == 0) {
 			pk_backend_job_set_allow_cancel (job, TRUE);
 		} else if (g_strcmp0 (sections[1], "false") == 0) {
@@ -498,21 +593,11 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 			ret = FALSE;
 			goto out;
 		}
-	} else if (g_strcmp0 (command, "no-percentage-updates") == 0) {
-		if (size != 1) {
-			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
-			ret = FALSE;
-			goto out;
-		}
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_NO_PERCENTAGE_UPDATES:
 		pk_backend_job_set_percentage (job, PK_BACKEND_PERCENTAGE_INVALID);
-	} else if (g_strcmp0 (command, "repo-signature-required") == 0) {
-
-		if (size != 9) {
-			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
-			ret = FALSE;
-			goto out;
-		}
-
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_REPO_SIGNATURE_REQUIRED:
 		sig_type = pk_sig_type_enum_from_string (sections[8]);
 		if (sig_type == PK_SIGTYPE_ENUM_UNKNOWN) {
 			g_set_error (error, 1, 0, "Sig enum not recognised, and hence ignored: '%s'", sections[8]);
@@ -534,16 +619,8 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 		pk_backend_job_repo_signature_required (job, sections[1],
 							  sections[2], sections[3], sections[4],
 							  sections[5], sections[6], sections[7], sig_type);
-		goto out;
-
-	} else if (g_strcmp0 (command, "eula-required") == 0) {
-
-		if (size != 5) {
-			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
-			ret = FALSE;
-			goto out;
-		}
-
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_EULA_REQUIRED:
 		if (pk_strzero (sections[1])) {
 			g_set_error (error, 1, 0, "eula_id blank, and hence ignored: '%s'", sections[1]);
 			ret = FALSE;
@@ -563,16 +640,8 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 		}
 
 		pk_backend_job_eula_required (job, sections[1], sections[2], sections[3], sections[4]);
-		goto out;
-
-	} else if (g_strcmp0 (command, "media-change-required") == 0) {
-
-		if (size != 4) {
-			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
-			ret = FALSE;
-			goto out;
-		}
-
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_MEDIA_CHANGE_REQUIRED:
 		media_type_enum = pk_media_type_enum_from_string (sections[1]);
 		if (media_type_enum == PK_MEDIA_TYPE_ENUM_UNKNOWN) {
 			g_set_error (error, 1, 0, "media type enum not recognised, and hence ignored: '%s'", sections[1]);
@@ -581,15 +650,8 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 		}
 
 		pk_backend_job_media_change_required (job, media_type_enum, sections[2], sections[3]);
-		goto out;
-	} else if (g_strcmp0 (command, "distro-upgrade") == 0) {
-
-		if (size != 4) {
-			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
-			ret = FALSE;
-			goto out;
-		}
-
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_DISTRO_UPGRADE:
 		distro_upgrade_enum = pk_distro_upgrade_enum_from_string (sections[1]);
 		if (distro_upgrade_enum == PK_DISTRO_UPGRADE_ENUM_UNKNOWN) {
 			g_set_error (error, 1, 0, "distro upgrade enum not recognised, and hence ignored: '%s'", sections[1]);
@@ -607,14 +669,8 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 		}
 
 		pk_backend_job_distro_upgrade (job, distro_upgrade_enum, sections[2], sections[3]);
-		goto out;
-	} else if (g_strcmp0 (command, "category") == 0) {
-
-		if (size != 6) {
-			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
-			ret = FALSE;
-			goto out;
-		}
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_CATEGORY:
 		if (g_strcmp0 (sections[1], sections[2]) == 0) {
 			g_set_error_literal (error, 1, 0, "cat_id cannot be the same as parent_id");
 			ret = FALSE;
@@ -650,13 +706,13 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 			goto out;
 		}
 		pk_backend_job_category (job, sections[1], sections[2], sections[3], sections[4], sections[5]);
-		goto out;
-	} else {
-		ret = FALSE;
-		g_set_error (error, 1, 0, "invalid command '%s'", command);
+		break;
+	default:
+		g_assert_not_reached ();
 	}
 out:
-	g_strfreev (sections);
+	pk_backend_spawn_fields_clear (&fields);
+	g_free (copy_heap);
 	return ret;
 }
 
@@ -32,6 +32,7 @@
 #endif
 
 #include "pk-dbus.h"
+#include "pk-dbus-private.h"
 
 #define PK_DBUS_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), PK_TYPE_DBUS, PkDbusPrivate))
 
@@ -41,12 +42,465 @@ struct PkDbusPrivate
 	GDBusProxy		*proxy_pid;
 	GDBusProxy		*proxy_uid;
 	GDBusProxy		*proxy_session;
+	GHashTable		*callers;
+	GHashTable		*callers_pending;
+	guint			 name_owner_changed_id;
+	gboolean		 no_credentials;
 };
 
+/* what we know about a unique name on the bus */
+typedef struct {
+	guint			 uid;
+	guint			 pid;
+	gchar			*cmdline;
+	gchar			*session;
+} PkDbusCaller;
+
+/* an in-flight lookup of the caller */
+typedef struct {
+	PkDbus			*dbus;
+	gchar			*sender;
+	guint			 uid;
+	guint			 pid;
+} PkDbusCallerHelper;
+
 static gpointer pk_dbus_object = NULL;
 
 G_DEFINE_TYPE (PkDbus, pk_dbus, G_TYPE_OBJECT)
 
+/**
+ * pk_dbus_caller_free:
+ **/
+static void
+pk_dbus_caller_free (PkDbusCaller *caller)
+{
+	g_free (caller->cmdline);
+	g_free (caller->session);
+	g_free (caller);
+}
+
+/**
+ * pk_dbus_add_caller:
+ **/
+static PkDbusCaller *
+pk_dbus_add_caller (PkDbus *dbus, const gchar *sender, guint uid, guint pid)
+{
+	PkDbusCaller *caller;
+
+	caller = g_new0 (PkDbusCaller, 1);
+	caller->uid = uid;
+	caller->pid = pid;
+	g_hash_table_insert (dbus->priv->callers, g_strdup (sender), caller);
+	return caller;
+}
+
+/**
+ * pk_dbus_parse_credentials:
+ * @value: the reply to GetConnectionCredentials
+ *
+ * Return value: %FALSE if there was no uid, which is all we need
+ **/
+static gboolean
+pk_dbus_parse_credentials (GVariant *value, guint *uid, guint *pid)
+{
+	gboolean ret;
+	GVariant *credentials;
+
+	credentials = g_variant_get_child_value (value, 0);
+	ret = g_variant_lookup (credentials, "UnixUserID", "u", uid);
+	if (ret && !g_variant_lookup (credentials, "ProcessID", "u", pid))
+		*pid = G_MAXUINT;
+	g_variant_unref (credentials);
+	return ret;
+}
+
+/**
+ * pk_dbus_credentials_failed:
+ *
+ * Buses older than dbus 1.7 don't have GetConnectionCredentials at all,
+ * so don't ask them again for every new caller.
+ **/
+static void
+pk_dbus_credentials_failed (PkDbus *dbus, const gchar *sender, const GError *error)
+{
+	if (g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD)) {
+		g_debug ("GetConnectionCredentials not supported: %s",
+			 error->message);
+		dbus->priv->no_credentials = TRUE;
+		return;
+	}
+	g_debug ("Failed to get credentials for %s: %s",
+		 sender, error->message);
+}
+
+/**
+ * pk_dbus_get_caller:
+ *
+ * Gets the cached credentials of the sender, asking the bus if they are
+ * not known yet.
+ *
+ * Return value: the caller, or %NULL if the bus does not support
+ * GetConnectionCredentials
+ **/
+static PkDbusCaller *
+pk_dbus_get_caller (PkDbus *dbus, const gchar *sender)
+{
+	GError *error = NULL;
+	GVariant *value;
+	guint pid;
+	guint uid;
+	PkDbusCaller *caller;
+
+	caller = g_hash_table_lookup (dbus->priv->callers, sender);
+	if (caller != NULL)
+		return caller;
+
+	/* no connection to DBus, or the bus is too old */
+	if (dbus->priv->proxy_uid == NULL || dbus->priv->no_credentials)
+		return NULL;
+
+	value = g_dbus_proxy_call_sync (dbus->priv->proxy_uid,
+					"GetConnectionCredentials",
+					g_variant_new ("(s)",
+						       sender),
+					G_DBUS_CALL_FLAGS_NONE,
+					2000,
+					NULL,
+					&error);
+	if (value == NULL) {
+		pk_dbus_credentials_failed (dbus, sender, error);
+		g_error_free (error);
+		return NULL;
+	}
+	if (pk_dbus_parse_credentials (value, &uid, &pid))
+		caller = pk_dbus_add_caller (dbus, sender, uid, pid);
+	else
+		g_warning ("no UnixUserID for %s", sender);
+	g_variant_unref (value);
+	return caller;
+}
+
+/**
+ * pk_dbus_caller_helper_done:
+ *
+ * Tells everybody who asked in the meantime, whether the caller could
+ * be looked up or not.
+ **/
+static void
+pk_dbus_caller_helper_done (PkDbusCallerHelper *helper)
+{
+	GPtrArray *pending;
+	guint i;
+	PkDbusPrivate *priv = helper->dbus->priv;
+
+	pending = g_hash_table_lookup (priv->callers_pending, helper->sender);
+	for (i = 0; i < pending->len; i++)
+		g_simple_async_result_complete (g_ptr_array_index (pending, i));
+	g_hash_table_remove (priv->callers_pending, helper->sender);
+
+	g_object_unref (helper->dbus);
+	g_free (helper->sender);
+	g_free (helper);
+}
+
+#ifndef PK_BUILD_SYSTEMD
+/**
+ * pk_dbus_get_session_cb:
+ **/
+static void
+pk_dbus_get_session_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+	GError *error = NULL;
+	GVariant *value;
+	PkDbusCaller *caller;
+	PkDbusCallerHelper *helper = (PkDbusCallerHelper *) user_data;
+
+	/* pk_dbus_get_session() will ask again if this failed */
+	value = g_dbus_proxy_call_finish (G_DBUS_PROXY (source), res, &error);
+	if (value == NULL) {
+		g_debug ("Failed to get session for %s: %s",
+			 helper->sender, error->message);
+		g_error_free (error);
+		goto out;
+	}
+
+	/* the caller might have left the bus meanwhile */
+	caller = g_hash_table_lookup (helper->dbus->priv->callers, helper->sender);
+	if (caller != NULL && caller->session == NULL)
+		g_variant_get (value, "(o)", &caller->session);
+	g_variant_unref (value);
+out:
+	pk_dbus_caller_helper_done (helper);
+}
+#endif
+
+/**
+ * pk_dbus_caller_helper_add:
+ *
+ * Caches the uid and pid, and gets the ConsoleKit session as well as
+ * most transactions need it.
+ **/
+static void
+pk_dbus_caller_helper_add (PkDbusCallerHelper *helper)
+{
+	pk_dbus_add_caller (helper->dbus, helper->sender, helper->uid, helper->pid);
+
+#ifndef PK_BUILD_SYSTEMD
+	if (helper->dbus->priv->proxy_session != NULL && helper->pid != G_MAXUINT) {
+		g_dbus_proxy_call (helper->dbus->priv->proxy_session,
+				   "GetSessionForUnixProcess",
+				   g_variant_new ("(u)",
+						  helper->pid),
+				   G_DBUS_CALL_FLAGS_NONE,
+				   2000,
+				   NULL,
+				   pk_dbus_get_session_cb,
+				   helper);
+		return;
+	}
+#endif
+	pk_dbus_caller_helper_done (helper);
+}
+
+/**
+ * pk_dbus_get_pid_cb:
+ **/
+static void
+pk_dbus_get_pid_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+	GError *error = NULL;
+	GVariant *value;
+	PkDbusCallerHelper *helper = (PkDbusCallerHelper *) user_data;
+
+	value = g_dbus_proxy_call_finish (G_DBUS_PROXY (source), res, &error);
+	if (value == NULL) {
+		g_debug ("Failed to get pid for %s: %s",
+			 helper->sender, error->message);
+		g_error_free (error);
+	} else {
+		g_variant_get (value, "(u)", &helper->pid);
+		g_variant_unref (value);
+	}
+	pk_dbus_caller_helper_add (helper);
+}
+
+/**
+ * pk_dbus_get_uid_cb:
+ **/
+static void
+pk_dbus_get_uid_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+	GError *error = NULL;
+	GVariant *value;
+	PkDbusCallerHelper *helper = (PkDbusCallerHelper *) user_data;
+
+	/* without the uid there is nothing worth keeping */
+	value = g_dbus_proxy_call_finish (G_DBUS_PROXY (source), res, &error);
+	if (value == NULL) {
+		g_debug ("Failed to get uid for %s: %s",
+			 helper->sender, error->message);
+		g_error_free (error);
+		pk_dbus_caller_helper_done (helper);
+		return;
+	}
+	g_variant_get (value, "(u)", &helper->uid);
+	g_variant_unref (value);
+
+	if (helper->dbus->priv->proxy_pid == NULL) {
+		pk_dbus_caller_helper_add (helper);
+		return;
+	}
+	g_dbus_proxy_call (helper->dbus->priv->proxy_pid,
+			   "GetConnectionUnixProcessID",
+			   g_variant_new ("(s)",
+					  helper->sender),
+			   G_DBUS_CALL_FLAGS_NONE,
+			   2000,
+			   NULL,
+			   pk_dbus_get_pid_cb,
+			   helper);
+}
+
+/**
+ * pk_dbus_caller_helper_get_uid:
+ *
+ * Uses the methods older buses have, one after the other.
+ **/
+static void
+pk_dbus_caller_helper_get_uid (PkDbusCallerHelper *helper)
+{
+	g_dbus_proxy_call (helper->dbus->priv->proxy_uid,
+			   "GetConnectionUnixUser",
+			   g_variant_new ("(s)",
+					  helper->sender),
+			   G_DBUS_CALL_FLAGS_NONE,
+			   2000,
+			   NULL,
+			   pk_dbus_get_uid_cb,
+			   helper);
+}
+
+/**
+ * pk_dbus_get_caller_cb:
+ **/
+static void
+pk_dbus_get_caller_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+	GError *error = NULL;
+	GVariant *value;
+	PkDbusCallerHelper *helper = (PkDbusCallerHelper *) user_data;
+
+	value = g_dbus_proxy_call_finish (G_DBUS_PROXY (source), res, &error);
+	if (value == NULL) {
+		pk_dbus_credentials_failed (helper->dbus, helper->sender, error);
+		g_error_free (error);
+		pk_dbus_caller_helper_get_uid (helper);
+		return;
+	}
+	if (!pk_dbus_parse_credentials (value, &helper->uid, &helper->pid)) {
+		g_variant_unref (value);
+		pk_dbus_caller_helper_get_uid (helper);
+		return;
+	}
+	g_variant_unref (value);
+	pk_dbus_caller_helper_add (helper);
+}
+
+/**
+ * pk_dbus_get_caller_async:
+ * @dbus: the #PkDbus instance
+ * @sender: the unique name of the caller
+ *
+ * Looks up the credentials and the session of the caller without
+ * blocking, so the other pk_dbus_get_*() functions can answer from the
+ * cache. Lookups for the same sender that are already in progress are
+ * shared.
+ **/
+void
+pk_dbus_get_caller_async (PkDbus *dbus,
+			  const gchar *sender,
+			  GAsyncReadyCallback callback,
+			  gpointer user_data)
+{
+	GPtrArray *pending;
+	GSimpleAsyncResult *res;
+	PkDbusCallerHelper *helper;
+	PkDbusPrivate *priv = dbus->priv;
+
+	g_return_if_fail (PK_IS_DBUS (dbus));
+	g_return_if_fail (sender != NULL);
+
+	res = g_simple_async_result_new (G_OBJECT (dbus),
+					 callback,
+					 user_data,
+					 pk_dbus_get_caller_async);
+
+	/* already known, set in the test suite, or no connection to DBus */
+	if (g_hash_table_lookup (priv->callers, sender) != NULL ||
+	    g_strcmp0 (sender, ":org.freedesktop.PackageKit") == 0 ||
+	    priv->proxy_uid == NULL) {
+		g_simple_async_result_complete_in_idle (res);
+		g_object_unref (res);
+		return;
+	}
+
+	/* somebody is already asking */
+	pending = g_hash_table_lookup (priv->callers_pending, sender);
+	if (pending != NULL) {
+		g_ptr_array_add (pending, res);
+		return;
+	}
+	pending = g_ptr_array_new_with_free_func (g_object_unref);
+	g_ptr_array_add (pending, res);
+	g_hash_table_insert (priv->callers_pending, g_strdup (sender), pending);
+
+	helper = g_new0 (PkDbusCallerHelper, 1);
+	helper->dbus = g_object_ref (dbus);
+	helper->sender = g_strdup (sender);
+	helper->uid = G_MAXUINT;
+	helper->pid = G_MAXUINT;
+
+	/* the bus is too old */
+	if (priv->no_credentials) {
+		pk_dbus_caller_helper_get_uid (helper);
+		return;
+	}
+	g_dbus_proxy_call (priv->proxy_uid,
+			   "GetConnectionCredentials",
+			   g_variant_new ("(s)",
+					  sender),
+			   G_DBUS_CALL_FLAGS_NONE,
+			   2000,
+			   NULL,
+			   pk_dbus_get_caller_cb,
+			   helper);
+}
+
+/**
+ * pk_dbus_get_caller_finish:
+ * @dbus: the #PkDbus instance
+ * @res: the #GAsyncResult
+ * @error: A #GError or %NULL
+ *
+ * Finishes pk_dbus_get_caller_async(). Failing to get the credentials
+ * is not an error, the pk_dbus_get_*() functions will then ask the
+ * bus themselves.
+ *
+ * Return value: %TRUE for success
+ **/
+gboolean
+pk_dbus_get_caller_finish (PkDbus *dbus, GAsyncResult *res, GError **error)
+{
+	GSimpleAsyncResult *simple;
+
+	g_return_val_if_fail (PK_IS_DBUS (dbus), FALSE);
+	g_return_val_if_fail (G_IS_SIMPLE_ASYNC_RESULT (res), FALSE);
+
+	simple = G_SIMPLE_ASYNC_RESULT (res);
+	if (g_simple_async_result_propagate_error (simple, error))
+		return FALSE;
+	return TRUE;
+}
+
+/**
+ * pk_dbus_has_caller:
+ * @dbus: the #PkDbus instance
+ * @sender: the unique name of the caller
+ *
+ * Return value: %TRUE if the credentials of the caller are cached
+ **/
+gboolean
+pk_dbus_has_caller (PkDbus *dbus, const gchar *sender)
+{
+	g_return_val_if_fail (PK_IS_DBUS (dbus), FALSE);
+	return g_hash_table_lookup (dbus->priv->callers, sender) != NULL;
+}
+
+/**
+ * pk_dbus_name_owner_changed_cb:
+ **/
+static void
+pk_dbus_name_owner_changed_cb (GDBusConnection *connection,
+			       const gchar *sender_name,
+			       const gchar *object_path,
+			       const gchar *interface_name,
+			       const gchar *signal_name,
+			       GVariant *parameters,
+			       gpointer user_data)
+{
+	const gchar *name;
+	const gchar *new_owner;
+	const gchar *old_owner;
+	PkDbus *dbus = PK_DBUS (user_data);
+
+	/* unique names are never reused, so forget them when they go */
+	g_variant_get (parameters, "(&s&s&s)", &name, &old_owner, &new_owner);
+	if (new_owner[0] != '\0')
+		return;
+	if (g_hash_table_remove (dbus->priv->callers, name))
+		g_debug ("%s left the bus, dropped its credentials", name);
+}
+
 /**
  * pk_dbus_get_uid:
  * @dbus: the #PkDbus instance
@@ -62,6 +516,7 @@ pk_dbus_get_uid (PkDbus *dbus, const gchar *sender)
 	GError *error = NULL;
 	guint uid = G_MAXUINT;
 	GVariant *value = NULL;
+	PkDbusCaller *caller;
 
 	g_return_val_if_fail (PK_IS_DBUS (dbus), G_MAXUINT);
 	g_return_val_if_fail (sender != NULL, G_MAXUINT);
@@ -73,6 +528,13 @@ pk_dbus_get_uid (PkDbus *dbus, const gchar *sender)
 		goto out;
 	}
 
+	/* cached, or from GetConnectionCredentials */
+	caller = pk_dbus_get_caller (dbus, sender);
+	if (caller != NULL) {
+		uid = caller->uid;
+		goto out;
+	}
+
 	value = g_dbus_proxy_call_sync (dbus->priv->proxy_uid,
 					"GetConnectionUnixUser",
 					g_variant_new ("(s)",
@@ -109,6 +571,7 @@ pk_dbus_get_pid (PkDbus *dbus, const gchar *sender)
 	GError *error = NULL;
 	guint pid = G_MAXUINT;
 	GVariant *value = NULL;
+	PkDbusCaller *caller;
 
 	g_return_val_if_fail (PK_IS_DBUS (dbus), G_MAXUINT);
 	g_return_val_if_fail (sender != NULL, G_MAXUINT);
@@ -120,6 +583,13 @@ pk_dbus_get_pid (PkDbus *dbus, const gchar *sender)
 		goto out;
 	}
 
+	/* cached, or from GetConnectionCredentials */
+	caller = pk_dbus_get_caller (dbus, sender);
+	if (caller != NULL) {
+		pid = caller->pid;
+		goto out;
+	}
+
 	/* no connection to DBus */
 	if (dbus->priv->proxy_pid == NULL)
 		goto out;
@@ -163,6 +633,7 @@ pk_dbus_get_cmdline (PkDbus *dbus, const gchar *sender)
 	gchar *cmdline = NULL;
 	GError *error = NULL;
 	guint pid;
+	PkDbusCaller *caller;
 
 	g_return_val_if_fail (PK_IS_DBUS (dbus), NULL);
 	g_return_val_if_fail (sender != NULL, NULL);
@@ -174,6 +645,13 @@ pk_dbus_get_cmdline (PkDbus *dbus, const gchar *sender)
 		goto out;
 	}
 
+	/* already read */
+	caller = g_hash_table_lookup (dbus->priv->callers, sender);
+	if (caller != NULL && caller->cmdline != NULL) {
+		cmdline = g_strdup (caller->cmdline);
+		goto out;
+	}
+
 	/* get pid */
 	pid = pk_dbus_get_pid (dbus, sender);
 	if (pid == G_MAXUINT) {
@@ -187,7 +665,13 @@ pk_dbus_get_cmdline (PkDbus *dbus, const gchar *sender)
 	if (!ret) {
 		g_warning ("failed to get cmdline: %s", error->message);
 		g_error_free (error);
+		goto out;
 	}
+
+	/* the process can't change while it owns the name */
+	caller = g_hash_table_lookup (dbus->priv->callers, sender);
+	if (caller != NULL)
+		caller->cmdline = g_strdup (cmdline);
 out:
 	g_free (filename);
 	return cmdline;
@@ -241,6 +725,7 @@ pk_dbus_get_session (PkDbus *dbus, const gchar *sender)
 #endif
 	guint pid;
 	GVariant *value = NULL;
+	PkDbusCaller *caller;
 
 	g_return_val_if_fail (PK_IS_DBUS (dbus), NULL);
 	g_return_val_if_fail (sender != NULL, NULL);
@@ -252,6 +737,13 @@ pk_dbus_get_session (PkDbus *dbus, const gchar *sender)
 		goto out;
 	}
 
+	/* already looked up */
+	caller = g_hash_table_lookup (dbus->priv->callers, sender);
+	if (caller != NULL && caller->session != NULL) {
+		session = g_strdup (caller->session);
+		goto out;
+	}
+
 	/* no ConsoleKit? */
 	if (dbus->priv->proxy_session == NULL) {
 		g_warning ("no ConsoleKit, so cannot get session");
@@ -286,6 +778,11 @@ pk_dbus_get_session (PkDbus *dbus, const gchar *sender)
 	}
 	g_variant_get (value, "(o)", &session);
 #endif
+
+	/* the process can't change session while it owns the name */
+	caller = g_hash_table_lookup (dbus->priv->callers, sender);
+	if (caller != NULL && session != NULL)
+		caller->session = g_strdup (session);
 out:
 	if (value != NULL)
 		g_variant_unref (value);
@@ -304,6 +801,12 @@ pk_dbus_finalize (GObject *object)
 	g_return_if_fail (PK_IS_DBUS (object));
 	dbus = PK_DBUS (object);
 
+	if (dbus->priv->name_owner_changed_id != 0) {
+		g_dbus_connection_signal_unsubscribe (dbus->priv->connection,
+						      dbus->priv->name_owner_changed_id);
+	}
+	g_hash_table_unref (dbus->priv->callers);
+	g_hash_table_unref (dbus->priv->callers_pending);
 	g_object_unref (dbus->priv->proxy_pid);
 	g_object_unref (dbus->priv->proxy_uid);
 	if (dbus->priv->proxy_session != NULL)
@@ -336,6 +839,10 @@ pk_dbus_init (PkDbus *dbus)
 {
 	GError *error = NULL;
 	dbus->priv = PK_DBUS_GET_PRIVATE (dbus);
+	dbus->priv->callers = g_hash_table_new_full (g_str_hash, g_str_equal,
+						     g_free, (GDestroyNotify) pk_dbus_caller_free);
+	dbus->priv->callers_pending = g_hash_table_new_full (g_str_hash, g_str_equal,
+							     g_free, (GDestroyNotify) g_ptr_array_unref);
 
 	/* use the bus to get the uid */
 	dbus->priv->connection = g_bus_get_sync (G_BUS_TYPE_SYSTEM,
@@ -394,6 +901,19 @@ pk_dbus_init (PkDbus *dbus)
 		g_warning ("cannot connect to DBus: %s", error->message);
 		g_error_free (error);
 	}
+
+	/* forget the cached credentials when the caller goes away */
+	dbus->priv->name_owner_changed_id =
+		g_dbus_connection_signal_subscribe (dbus->priv->connection,
+						    "org.freedesktop.DBus",
+						    "org.freedesktop.DBus",
+						    "NameOwnerChanged",
+						    "/org/freedesktop/DBus",
+						    NULL,
+						    G_DBUS_SIGNAL_FLAGS_NONE,
+						    pk_dbus_name_owner_changed_cb,
+						    dbus,
+						    NULL);
 }
 
 /**
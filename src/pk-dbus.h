@@ -23,6 +23,7 @@
 #define __PK_DBUS_H
 
 #include <glib-object.h>
+#include <gio/gio.h>
 
 G_BEGIN_DECLS
 
@@ -57,6 +58,13 @@ gchar		*pk_dbus_get_cmdline		(PkDbus		*dbus,
 						 const gchar	*sender);
 gchar		*pk_dbus_get_session		(PkDbus		*dbus,
 						 const gchar	*sender);
+void		 pk_dbus_get_caller_async	(PkDbus		*dbus,
+						 const gchar	*sender,
+						 GAsyncReadyCallback callback,
+						 gpointer	 user_data);
+gboolean	 pk_dbus_get_caller_finish	(PkDbus		*dbus,
+						 GAsyncResult	*res,
+						 GError		**error);
 
 G_END_DECLS
 
@@ -1352,6 +1352,49 @@ out:
 	return value;
 }
 
+/**
+ * pk_engine_create_transaction_cb:
+ **/
+static void
+pk_engine_create_transaction_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+	gboolean ret;
+	gchar *tid;
+	GError *error = NULL;
+	GDBusMethodInvocation *invocation = G_DBUS_METHOD_INVOCATION (user_data);
+	PkEngine *engine = PK_ENGINE (g_dbus_method_invocation_get_user_data (invocation));
+
+	/* the credentials are now cached, or will be looked up again */
+	ret = pk_dbus_get_caller_finish (PK_DBUS (source), res, &error);
+	if (!ret) {
+		g_debug ("failed to look up caller: %s", error->message);
+		g_clear_error (&error);
+	}
+
+	tid = pk_transaction_db_generate_id (engine->priv->transaction_db);
+	g_assert (tid != NULL);
+	ret = pk_transaction_list_create (engine->priv->transaction_list,
+					  tid,
+					  g_dbus_method_invocation_get_sender (invocation),
+					  &error);
+	if (!ret) {
+		g_dbus_method_invocation_return_error (invocation,
+						       PK_ENGINE_ERROR,
+						       PK_ENGINE_ERROR_CANNOT_CHECK_AUTH,
+						       "could not create transaction %s: %s",
+						       tid,
+						       error->message);
+		g_error_free (error);
+		goto out;
+	}
+
+	g_debug ("sending object path: '%s'", tid);
+	g_dbus_method_invocation_return_value (invocation,
+					       g_variant_new ("(o)", tid));
+out:
+	g_free (tid);
+}
+
 /**
  * pk_engine_daemon_method_call:
  **/
@@ -1426,24 +1469,12 @@ pk_engine_daemon_method_call (GDBusConnection *connection_, const gchar *sender,
 	if (g_strcmp0 (method_name, "CreateTransaction") == 0) {
 
 		g_debug ("CreateTransaction method called");
-		data = pk_transaction_db_generate_id (engine->priv->transaction_db);
-		g_assert (data != NULL);
-		ret = pk_transaction_list_create (engine->priv->transaction_list,
-						  data, sender, &error);
-		if (!ret) {
-			g_dbus_method_invocation_return_error (invocation,
-							       PK_ENGINE_ERROR,
-							       PK_ENGINE_ERROR_CANNOT_CHECK_AUTH,
-							       "could not create transaction %s: %s",
-							       data,
-							       error->message);
-			g_error_free (error);
-			goto out;
-		}
 
-		g_debug ("sending object path: '%s'", data);
-		value = g_variant_new ("(o)", data);
-		g_dbus_method_invocation_return_value (invocation, value);
+		/* don't block the daemon while the bus looks up the caller */
+		pk_dbus_get_caller_async (engine->priv->dbus,
+					  sender,
+					  pk_engine_create_transaction_cb,
+					  invocation);
 		goto out;
 	}
 
@@ -21,6 +21,7 @@
 
 #include <config.h>
 
+#include <unistd.h>
 #include <glib.h>
 #include <glib-object.h>
 #include <glib/gstdio.h>
@@ -28,6 +29,7 @@
 #include "pk-backend.h"
 #include "pk-backend-spawn.h"
 #include "pk-dbus.h"
+#include "pk-dbus-private.h"
 #include "pk-engine.h"
 #include "pk-notify.h"
 #include "pk-spawn.h"
@@ -328,6 +330,110 @@ pk_test_backend_func (void)
 	g_object_unref (backend);
 }
 
+static guint _backend_job_packages_chunks = 0;
+static guint _backend_job_packages_number = 0;
+static guint _backend_job_packages_percentage = 0;
+
+/**
+ * pk_test_backend_job_packages_cb:
+ **/
+static void
+pk_test_backend_job_packages_cb (PkBackendJob *job, GPtrArray *array, gpointer user_data)
+{
+	PkPackage *package;
+	gchar *package_id;
+	guint i;
+
+	/* check they arrive in order */
+	for (i = 0; i < array->len; i++) {
+		package = g_ptr_array_index (array, i);
+		package_id = g_strdup_printf ("test;%u;noarch;data",
+					      _backend_job_packages_number++);
+		g_assert_cmpstr (pk_package_get_id (package), ==, package_id);
+		g_free (package_id);
+	}
+	_backend_job_packages_chunks++;
+}
+
+/**
+ * pk_test_backend_job_packages_percentage_cb:
+ **/
+static void
+pk_test_backend_job_packages_percentage_cb (PkBackendJob *job, guint percentage, gpointer user_data)
+{
+	/* only the packages emitted before it, none of the ones after */
+	g_assert_cmpint (_backend_job_packages_number, ==, 1250);
+	_backend_job_packages_percentage = percentage;
+}
+
+/**
+ * pk_test_backend_job_packages_finished_cb:
+ **/
+static void
+pk_test_backend_job_packages_finished_cb (PkBackendJob *job, PkExitEnum exit, gpointer user_data)
+{
+	/* everything has to be delivered before finished */
+	g_assert_cmpint (_backend_job_packages_number, ==, 2500);
+	_g_test_loop_quit ();
+}
+
+static gpointer
+pk_test_backend_job_packages_thread (gpointer user_data)
+{
+	PkBackendJob *job = PK_BACKEND_JOB (user_data);
+	gchar *package_id;
+	guint i;
+
+	for (i = 0; i < 2500; i++) {
+		if (i == 1250)
+			pk_backend_job_set_percentage (job, 50);
+		package_id = g_strdup_printf ("test;%u;noarch;data", i);
+		pk_backend_job_package (job, PK_INFO_ENUM_AVAILABLE,
+					package_id, "summary");
+		g_free (package_id);
+	}
+	pk_backend_job_finished (job);
+	return NULL;
+}
+
+static void
+pk_test_backend_job_packages_func (void)
+{
+	GKeyFile *conf;
+	GThread *thread;
+	PkBackendJob *job;
+
+	conf = g_key_file_new ();
+	job = pk_backend_job_new (conf);
+	pk_backend_job_set_vfunc (job,
+				  PK_BACKEND_SIGNAL_PACKAGES,
+				  (PkBackendJobVFunc) pk_test_backend_job_packages_cb,
+				  NULL);
+	pk_backend_job_set_vfunc (job,
+				  PK_BACKEND_SIGNAL_PERCENTAGE,
+				  (PkBackendJobVFunc) pk_test_backend_job_packages_percentage_cb,
+				  NULL);
+	pk_backend_job_set_vfunc (job,
+				  PK_BACKEND_SIGNAL_FINISHED,
+				  (PkBackendJobVFunc) pk_test_backend_job_packages_finished_cb,
+				  NULL);
+
+	/* emit from another thread like a backend does */
+	thread = g_thread_new ("pk-test-packages",
+			       pk_test_backend_job_packages_thread,
+			       job);
+	_g_test_loop_run_with_timeout (5000);
+	g_thread_join (thread);
+
+	/* all the packages, in chunks */
+	g_assert_cmpint (_backend_job_packages_number, ==, 2500);
+	g_assert_cmpint (_backend_job_packages_chunks, >=, 3);
+	g_assert_cmpint (_backend_job_packages_percentage, ==, 50);
+
+	g_object_unref (job);
+	g_key_file_unref (conf);
+}
+
 static guint _backend_spawn_number_packages = 0;
 
 /**
@@ -412,6 +518,14 @@ pk_test_backend_spawn_func (void)
 	ret = pk_backend_spawn_inject_data (backend_spawn, job, "percentage", NULL);
 	g_assert (!ret);
 
+	/* test pk_backend_spawn_inject_data unknown command */
+	ret = pk_backend_spawn_inject_data (backend_spawn, job, "packagf\tinstalled", NULL);
+	g_assert (!ret);
+
+	/* test pk_backend_spawn_inject_data empty line */
+	ret = pk_backend_spawn_inject_data (backend_spawn, job, "", NULL);
+	g_assert (!ret);
+
 	/* test pk_backend_spawn_inject_data NoPercentageUpdates */
 	ret = pk_backend_spawn_inject_data (backend_spawn, job, "no-percentage-updates", NULL);
 	g_assert (ret);
@@ -516,19 +630,103 @@ pk_test_backend_spawn_func (void)
 	g_key_file_unref (conf);
 }
 
+/**
+ * pk_test_dbus_get_caller_cb:
+ **/
+static void
+pk_test_dbus_get_caller_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+	gboolean ret;
+	guint *remaining = (guint *) user_data;
+	GError *error = NULL;
+
+	ret = pk_dbus_get_caller_finish (PK_DBUS (source), res, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	if (--(*remaining) == 0)
+		_g_test_loop_quit ();
+}
+
 static void
 pk_test_dbus_func (void)
 {
+	gchar *address;
+	gchar *cmdline;
+	gchar *sender;
+	guint i;
+	guint remaining;
+	GDBusConnection *connection;
+	GError *error = NULL;
 	PkDbus *dbus;
 
 	dbus = pk_dbus_new ();
 	g_assert (dbus != NULL);
 
+	/* look up the caller without blocking */
+	remaining = 1;
+	pk_dbus_get_caller_async (dbus, ":org.freedesktop.PackageKit",
+				  pk_test_dbus_get_caller_cb, &remaining);
+	_g_test_loop_run_with_timeout (5000);
+	g_assert_cmpint (remaining, ==, 0);
+	g_assert_cmpint (pk_dbus_get_uid (dbus, ":org.freedesktop.PackageKit"), ==, 500);
+	cmdline = pk_dbus_get_cmdline (dbus, ":org.freedesktop.PackageKit");
+	g_assert_cmpstr (cmdline, ==, "/usr/sbin/packagekit");
+	g_free (cmdline);
+
+	/* use a private connection as a real caller so it can leave */
+	address = g_dbus_address_get_for_bus_sync (G_BUS_TYPE_SYSTEM, NULL, &error);
+	g_assert_no_error (error);
+	connection = g_dbus_connection_new_for_address_sync (address,
+							     G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+							     G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+							     NULL, NULL, &error);
+	g_assert_no_error (error);
+	sender = g_strdup (g_dbus_connection_get_unique_name (connection));
+	g_assert (sender != NULL);
+	g_assert (!pk_dbus_has_caller (dbus, sender));
+
+	/* the second lookup waits for the first one */
+	remaining = 2;
+	pk_dbus_get_caller_async (dbus, sender,
+				  pk_test_dbus_get_caller_cb, &remaining);
+	pk_dbus_get_caller_async (dbus, sender,
+				  pk_test_dbus_get_caller_cb, &remaining);
+	g_assert_cmpint (remaining, ==, 2);
+	_g_test_loop_run_with_timeout (5000);
+	g_assert_cmpint (remaining, ==, 0);
+	if (!pk_dbus_has_caller (dbus, sender)) {
+#if GLIB_CHECK_VERSION(2,38,0)
+		g_test_skip ("the system bus did not return the credentials");
+#endif
+		goto out;
+	}
+	g_assert_cmpint (pk_dbus_get_uid (dbus, sender), ==, getuid ());
+	g_assert_cmpint (pk_dbus_get_pid (dbus, sender), ==, getpid ());
+
+	/* answered from the cache now */
+	remaining = 1;
+	pk_dbus_get_caller_async (dbus, sender,
+				  pk_test_dbus_get_caller_cb, &remaining);
+	_g_test_loop_run_with_timeout (5000);
+	g_assert_cmpint (remaining, ==, 0);
+	g_assert (pk_dbus_has_caller (dbus, sender));
+
+	/* forget the caller when it leaves the bus */
+	g_dbus_connection_close_sync (connection, NULL, &error);
+	g_assert_no_error (error);
+	for (i = 0; i < 50 && pk_dbus_has_caller (dbus, sender); i++)
+		_g_test_loop_wait (100);
+	g_assert (!pk_dbus_has_caller (dbus, sender));
+out:
+	g_free (address);
+	g_free (sender);
+	g_object_unref (connection);
 	g_object_unref (dbus);
 }
 
 PkSpawnExitType mexit = PK_SPAWN_EXIT_TYPE_UNKNOWN;
 guint stdout_count = 0;
+gchar *stdout_last = NULL;
 guint finished_count = 0;
 
 /**
@@ -551,6 +749,8 @@ pk_test_stdout_cb (PkSpawn *spawn, const gchar *line, gpointer user_data)
 {
 	g_debug ("stdout '%s'", line);
 	stdout_count++;
+	g_free (stdout_last);
+	stdout_last = g_strdup (line);
 }
 
 static gboolean
@@ -702,6 +902,40 @@ pk_test_spawn_func (void)
 	/* make sure finished in SIGQUIT */
 	g_assert_cmpint (mexit, ==, PK_SPAWN_EXIT_TYPE_SIGQUIT);
 
+	/* get new object */
+	new_spawn_object (&spawn);
+
+	/* make sure a burst of output split over several reads is all there */
+	mexit = PK_SPAWN_EXIT_TYPE_UNKNOWN;
+	argv = g_strsplit (TESTDATADIR "/pk-spawn-test-burst.sh", " ", 0);
+	ret = pk_spawn_argv (spawn, argv, NULL, PK_SPAWN_ARGV_FLAGS_NONE, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_strfreev (argv);
+
+	/* wait for finished */
+	_g_test_loop_run_with_timeout (5000);
+	g_assert_cmpint (mexit, ==, PK_SPAWN_EXIT_TYPE_SUCCESS);
+	g_assert_cmpint (stdout_count, ==, 1000);
+	g_assert_cmpstr (stdout_last, ==, "package\tavailable\tpolkit;0.0.1;i386;data\tPolicyKit daemon 1000");
+
+	/* get new object */
+	new_spawn_object (&spawn);
+
+	/* make sure a child exiting a while after closing stdout is noticed */
+	mexit = PK_SPAWN_EXIT_TYPE_UNKNOWN;
+	argv = g_strsplit (TESTDATADIR "/pk-spawn-test-close.sh", " ", 0);
+	ret = pk_spawn_argv (spawn, argv, NULL, PK_SPAWN_ARGV_FLAGS_NONE, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_strfreev (argv);
+
+	/* wait for finished */
+	_g_test_loop_run_with_timeout (5000);
+	g_assert_cmpint (mexit, ==, PK_SPAWN_EXIT_TYPE_SUCCESS);
+	g_assert_cmpint (stdout_count, ==, 1);
+	g_assert (!pk_spawn_is_running (spawn));
+
 	/* run lots of data for profiling */
 	argv = g_strsplit (TESTDATADIR "/pk-spawn-test-profiling.sh", " ", 0);
 	ret = pk_spawn_argv (spawn, argv, NULL, PK_SPAWN_ARGV_FLAGS_NONE, &error);
@@ -1030,6 +1264,19 @@ pk_test_transaction_list_create_transaction (PkTransactionList *tlist)
 	return tid;
 }
 
+/**
+ * pk_test_transaction_list_connect_finished:
+ **/
+static void
+pk_test_transaction_list_connect_finished (PkTransactionList *tlist, const gchar *tid)
+{
+	PkTransaction *transaction;
+
+	transaction = pk_transaction_list_get_transaction (tlist, tid);
+	g_signal_connect (transaction, "finished",
+			  G_CALLBACK (pk_test_transaction_list_finished_cb), NULL);
+}
+
 static void
 pk_test_transaction_list_func (void)
 {
@@ -1091,6 +1338,7 @@ pk_test_transaction_list_func (void)
 	transaction = pk_transaction_list_get_transaction (tlist, tid);
 	g_assert (transaction != NULL);
 	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_NEW);
+	g_assert (pk_transaction_list_get_transaction (tlist, "/not/in/the/list") == NULL);
 
 	/* get size one we have in queue */
 	size = pk_transaction_list_get_size (tlist);
@@ -1342,6 +1590,154 @@ pk_test_transaction_list_func (void)
 	g_assert_cmpint (size, ==, 0);
 	g_strfreev (array);
 
+	/* create three more, the second one committed last */
+	tid_item1 = pk_test_transaction_list_create_transaction (tlist);
+	tid_item2 = pk_test_transaction_list_create_transaction (tlist);
+	tid_item3 = pk_test_transaction_list_create_transaction (tlist);
+	pk_test_transaction_list_connect_finished (tlist, tid_item1);
+	pk_test_transaction_list_connect_finished (tlist, tid_item2);
+	pk_test_transaction_list_connect_finished (tlist, tid_item3);
+
+	/* this takes the backend lock once it is running */
+	transaction = pk_transaction_list_get_transaction (tlist, tid_item1);
+	pk_transaction_skip_auth_checks (transaction, TRUE);
+	pk_transaction_refresh_cache (transaction, g_variant_new ("(b)", FALSE), NULL);
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_RUNNING);
+	g_assert (!pk_transaction_is_exclusive (transaction));
+
+	/* which makes it exclusive while running */
+	_g_test_loop_wait (500);
+	transaction = pk_transaction_list_get_transaction (tlist, tid_item1);
+	g_assert (pk_transaction_is_exclusive (transaction));
+
+	/* so this exclusive action has to wait */
+	array = g_strsplit ("power", " ", -1);
+	transaction = pk_transaction_list_get_transaction (tlist, tid_item3);
+	pk_transaction_make_exclusive (transaction);
+	pk_transaction_search_names (transaction,
+				     g_variant_new ("(t^as)",
+						    pk_bitfield_value (PK_FILTER_ENUM_NONE),
+						    array),
+				     NULL);
+	g_strfreev (array);
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_READY);
+
+	/* this runs at once, but finds the backend locked */
+	transaction = pk_transaction_list_get_transaction (tlist, tid_item2);
+	pk_transaction_skip_auth_checks (transaction, TRUE);
+	pk_transaction_refresh_cache (transaction, g_variant_new ("(b)", FALSE), NULL);
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_RUNNING);
+
+	/* wait for the lock error */
+	_g_test_loop_run_with_timeout (10000);
+
+	/* transaction2 is exclusive now, and waits for transaction1 */
+	transaction = pk_transaction_list_get_transaction (tlist, tid_item2);
+	g_assert (pk_transaction_is_exclusive (transaction));
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_READY);
+	transaction = pk_transaction_list_get_transaction (tlist, tid_item1);
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_RUNNING);
+	transaction = pk_transaction_list_get_transaction (tlist, tid_item3);
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_READY);
+
+	/* wait for transaction1 */
+	_g_test_loop_run_with_timeout (10000);
+
+	/* the retried transaction2 is older, so goes before transaction3 */
+	transaction = pk_transaction_list_get_transaction (tlist, tid_item1);
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_FINISHED);
+	transaction = pk_transaction_list_get_transaction (tlist, tid_item2);
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_RUNNING);
+	transaction = pk_transaction_list_get_transaction (tlist, tid_item3);
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_READY);
+
+	/* wait for transaction2 */
+	_g_test_loop_run_with_timeout (10000);
+	transaction = pk_transaction_list_get_transaction (tlist, tid_item2);
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_FINISHED);
+	transaction = pk_transaction_list_get_transaction (tlist, tid_item3);
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_RUNNING);
+
+	/* wait for transaction3 */
+	_g_test_loop_run_with_timeout (10000);
+	transaction = pk_transaction_list_get_transaction (tlist, tid_item3);
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_FINISHED);
+
+	g_free (tid_item1);
+	g_free (tid_item2);
+	g_free (tid_item3);
+
+	/* create three more, the second one in the background */
+	tid_item1 = pk_test_transaction_list_create_transaction (tlist);
+	tid_item2 = pk_test_transaction_list_create_transaction (tlist);
+	tid_item3 = pk_test_transaction_list_create_transaction (tlist);
+	pk_test_transaction_list_connect_finished (tlist, tid_item1);
+	pk_test_transaction_list_connect_finished (tlist, tid_item2);
+	pk_test_transaction_list_connect_finished (tlist, tid_item3);
+
+	/* this takes the backend lock */
+	transaction = pk_transaction_list_get_transaction (tlist, tid_item1);
+	pk_transaction_skip_auth_checks (transaction, TRUE);
+	pk_transaction_refresh_cache (transaction, g_variant_new ("(b)", FALSE), NULL);
+	_g_test_loop_wait (500);
+	g_assert (pk_transaction_is_exclusive (transaction));
+
+	/* this waits, and is moved to the background while waiting */
+	array = g_strsplit ("dave", " ", -1);
+	transaction = pk_transaction_list_get_transaction (tlist, tid_item2);
+	pk_transaction_make_exclusive (transaction);
+	pk_transaction_search_details (transaction,
+				       g_variant_new ("(t^as)",
+						      pk_bitfield_value (PK_FILTER_ENUM_NONE),
+						      array),
+				       NULL);
+	g_strfreev (array);
+	pk_transaction_list_set_background (tlist, tid_item2, TRUE);
+
+	/* this waits in the foreground */
+	array = g_strsplit ("paul", " ", -1);
+	transaction = pk_transaction_list_get_transaction (tlist, tid_item3);
+	pk_transaction_make_exclusive (transaction);
+	pk_transaction_search_names (transaction,
+				     g_variant_new ("(t^as)",
+						    pk_bitfield_value (PK_FILTER_ENUM_NONE),
+						    array),
+				     NULL);
+	g_strfreev (array);
+
+	/* wait for transaction1 */
+	_g_test_loop_run_with_timeout (10000);
+
+	/* the foreground one goes first, even though it is newer */
+	transaction = pk_transaction_list_get_transaction (tlist, tid_item1);
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_FINISHED);
+	transaction = pk_transaction_list_get_transaction (tlist, tid_item2);
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_READY);
+	transaction = pk_transaction_list_get_transaction (tlist, tid_item3);
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_RUNNING);
+
+	/* wait for transaction3 */
+	_g_test_loop_run_with_timeout (10000);
+	transaction = pk_transaction_list_get_transaction (tlist, tid_item3);
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_FINISHED);
+	transaction = pk_transaction_list_get_transaction (tlist, tid_item2);
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_RUNNING);
+
+	/* wait for transaction2 */
+	_g_test_loop_run_with_timeout (10000);
+	transaction = pk_transaction_list_get_transaction (tlist, tid_item2);
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_FINISHED);
+
+	/* nothing left to run */
+	array = pk_transaction_list_get_array (tlist);
+	size = g_strv_length (array);
+	g_assert_cmpint (size, ==, 0);
+	g_strfreev (array);
+
+	g_free (tid_item1);
+	g_free (tid_item2);
+	g_free (tid_item3);
+
 	g_object_unref (tlist);
 	g_object_unref (backend);
 	g_object_unref (db);
@@ -1596,6 +1992,7 @@ main (int argc, char **argv)
 
 	/* backend stuff */
 	g_test_add_func ("/packagekit/backend", pk_test_backend_func);
+	g_test_add_func ("/packagekit/backend-job-packages", pk_test_backend_job_packages_func);
 	g_test_add_func ("/packagekit/backend_spawn", pk_test_backend_spawn_func);
 
 	return g_test_run ();
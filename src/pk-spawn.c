@@ -46,9 +46,13 @@
 #include "pk-sysdep.h"
 
 static void     pk_spawn_finalize	(GObject       *object);
+static void     pk_spawn_set_poll	(PkSpawn       *spawn,
+					 guint		delay);
 
 #define PK_SPAWN_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), PK_TYPE_SPAWN, PkSpawnPrivate))
-#define PK_SPAWN_POLL_DELAY	50 /* ms */
+#define PK_SPAWN_POLL_DELAY	250 /* ms */
+#define PK_SPAWN_EXIT_DELAY	5 /* ms */
+#define PK_SPAWN_EXIT_RETRIES	20
 #define PK_SPAWN_SIGKILL_DELAY	2500 /* ms */
 
 struct PkSpawnPrivate
@@ -57,8 +61,11 @@ struct PkSpawnPrivate
 	gint			 stdin_fd;
 	gint			 stdout_fd;
 	gint			 stderr_fd;
+	guint			 stdout_id;
+	guint			 stderr_id;
 	guint			 poll_id;
 	guint			 kill_id;
+	guint			 exit_retries;
 	gboolean		 finished;
 	gboolean		 background;
 	gboolean		 is_sending_exit;
@@ -66,6 +73,8 @@ struct PkSpawnPrivate
 	gboolean		 allow_sigkill;
 	PkSpawnExitType		 exit;
 	GString			*stdout_buf;
+	gsize			 stdout_pos;
+	gsize			 stdout_scanned;
 	GString			*stderr_buf;
 	gchar			*last_argv0;
 	gchar			**last_envp;
@@ -92,58 +101,90 @@ G_DEFINE_TYPE (PkSpawn, pk_spawn, G_TYPE_OBJECT)
 
 /**
  * pk_spawn_read_fd_into_buffer:
+ *
+ * Return value: %FALSE if the other end was closed
  **/
 static gboolean
 pk_spawn_read_fd_into_buffer (gint fd, GString *string)
 {
-	gint bytes_read;
-	gchar buffer[BUFSIZ];
+	gssize bytes_read;
+	gsize len;
 
-	/* ITS4: ignore, we manually NULL terminate and GString cannot overflow */
-	while ((bytes_read = read (fd, buffer, BUFSIZ-1)) > 0) {
-		buffer[bytes_read] = '\0';
-		g_string_append (string, buffer);
-	}
+	if (fd == -1)
+		return FALSE;
 
-	return TRUE;
+	/* read straight into the end of the buffer */
+	while (TRUE) {
+		len = string->len;
+		g_string_set_size (string, len + BUFSIZ);
+		bytes_read = read (fd, string->str + len, BUFSIZ);
+		g_string_set_size (string, len + MAX (bytes_read, 0));
+		if (bytes_read > 0)
+			continue;
+		if (bytes_read == 0)
+			return FALSE;
+		if (errno == EINTR)
+			continue;
+		return errno == EAGAIN || errno == EWOULDBLOCK;
+	}
 }
 
 /**
  * pk_spawn_emit_whole_lines:
+ *
+ * Emits the complete lines in the stdout buffer, only looking at data
+ * that has not been scanned before. The lines are terminated in place
+ * and the processed text is removed once at the end, so the cost is
+ * linear in the amount of output however it is split up.
  **/
-static gboolean
-pk_spawn_emit_whole_lines (PkSpawn *spawn, GString *string)
+static void
+pk_spawn_emit_whole_lines (PkSpawn *spawn)
 {
-	guint i;
-	guint size;
-	gchar **lines;
-	guint bytes_processed;
-
-	/* if nothing then don't emit */
-	if (pk_strzero (string->str))
-		return FALSE;
-
-	/* split into lines - the last line may be incomplete */
-	lines = g_strsplit (string->str, "\n", 0);
-	if (lines == NULL)
-		return FALSE;
-
-	/* find size */
-	size = g_strv_length (lines);
+	gchar *line;
+	gchar *newline;
+	GString *string = spawn->priv->stdout_buf;
+	PkSpawnPrivate *priv = spawn->priv;
 
-	bytes_processed = 0;
-	/* we only emit n-1 strings */
-	for (i=0; i<(size-1); i++) {
-		g_signal_emit (spawn, signals [SIGNAL_STDOUT], 0, lines[i]);
-		/* ITS4: ignore, g_strsplit always NULL terminates */
-		bytes_processed += strlen (lines[i]) + 1;
+	/* the handlers may read more output, so always use the priv offsets */
+	while (priv->stdout_scanned < string->len) {
+		newline = memchr (string->str + priv->stdout_scanned, '\n',
+				  string->len - priv->stdout_scanned);
+		if (newline == NULL) {
+			priv->stdout_scanned = string->len;
+			break;
+		}
+		*newline = '\0';
+		line = string->str + priv->stdout_pos;
+		priv->stdout_pos = newline - string->str + 1;
+		priv->stdout_scanned = priv->stdout_pos;
+		g_signal_emit (spawn, signals [SIGNAL_STDOUT], 0, line);
 	}
 
 	/* remove the text we've processed */
-	g_string_erase (string, 0, bytes_processed);
+	if (priv->stdout_pos > 0) {
+		g_string_erase (string, 0, priv->stdout_pos);
+		priv->stdout_scanned -= priv->stdout_pos;
+		priv->stdout_pos = 0;
+	}
+}
 
-	g_strfreev (lines);
-	return TRUE;
+/**
+ * pk_spawn_emit_stderr:
+ **/
+static void
+pk_spawn_emit_stderr (PkSpawn *spawn)
+{
+	gchar *text;
+
+	/* emit all lines on standard error in one callback, as it's all probably
+	* related to the error that just happened */
+	if (spawn->priv->stderr_buf->len == 0)
+		return;
+	text = g_strndup (spawn->priv->stderr_buf->str,
+			  spawn->priv->stderr_buf->len);
+	g_string_set_size (spawn->priv->stderr_buf, 0);
+	g_signal_emit (spawn, signals [SIGNAL_STDERR], 0, text);
+	g_free (text);
 }
 
 /**
@@ -167,6 +208,26 @@ pk_spawn_exit_type_enum_to_string (PkSpawnExitType type)
 	return "unknown";
 }
 
+/**
+ * pk_spawn_remove_sources:
+ **/
+static void
+pk_spawn_remove_sources (PkSpawn *spawn)
+{
+	if (spawn->priv->poll_id != 0) {
+		g_source_remove (spawn->priv->poll_id);
+		spawn->priv->poll_id = 0;
+	}
+	if (spawn->priv->stdout_id != 0) {
+		g_source_remove (spawn->priv->stdout_id);
+		spawn->priv->stdout_id = 0;
+	}
+	if (spawn->priv->stderr_id != 0) {
+		g_source_remove (spawn->priv->stderr_id);
+		spawn->priv->stderr_id = 0;
+	}
+}
+
 /**
  * pk_spawn_check_child:
  **/
@@ -185,18 +246,13 @@ pk_spawn_check_child (PkSpawn *spawn)
 		return FALSE;
 	}
 
+	/* anything the watches have not picked up yet */
 	pk_spawn_read_fd_into_buffer (spawn->priv->stdout_fd, spawn->priv->stdout_buf);
 	pk_spawn_read_fd_into_buffer (spawn->priv->stderr_fd, spawn->priv->stderr_buf);
-
-	/* emit all lines on standard out in one callback, as it's all probably
-	* related to the error that just happened */
-	if (spawn->priv->stderr_buf->len != 0) {
-		g_signal_emit (spawn, signals [SIGNAL_STDERR], 0, spawn->priv->stderr_buf->str);
-		g_string_set_size (spawn->priv->stderr_buf, 0);
-	}
+	pk_spawn_emit_stderr (spawn);
 
 	/* all usual output goes on standard out, only bad libraries bitch to stderr */
-	pk_spawn_emit_whole_lines (spawn, spawn->priv->stdout_buf);
+	pk_spawn_emit_whole_lines (spawn);
 
 	/* Only print one in twenty times to avoid filling the screen */
 	if (limit_printing++ % 20 == 0)
@@ -210,6 +266,13 @@ pk_spawn_check_child (PkSpawn *spawn)
 	}
 	if (pid == 0) {
 		/* process still exist, but has not changed state */
+		if (spawn->priv->exit_retries > 0 &&
+		    --spawn->priv->exit_retries == 0) {
+			/* it closed stdout but keeps running, poll slowly again */
+			g_debug ("child still running after closing stdout");
+			pk_spawn_set_poll (spawn, PK_SPAWN_POLL_DELAY);
+			return FALSE;
+		}
 		return TRUE;
 	}
 	if (pid != spawn->priv->child_pid) {
@@ -218,11 +281,8 @@ pk_spawn_check_child (PkSpawn *spawn)
 		return TRUE;
 	}
 
-	/* disconnect the poll as there will be no more updates */
-	if (spawn->priv->poll_id > 0) {
-		g_source_remove (spawn->priv->poll_id);
-		spawn->priv->poll_id = 0;
-	}
+	/* disconnect the poll and the watches as there will be no more updates */
+	pk_spawn_remove_sources (spawn);
 
 	/* child exited, close resources */
 	close (spawn->priv->stdin_fd);
@@ -292,6 +352,77 @@ pk_spawn_check_child (PkSpawn *spawn)
 	return FALSE;
 }
 
+/**
+ * pk_spawn_set_poll:
+ *
+ * Sets how often to check if the child exited, the output is
+ * handled as soon as it arrives by the fd watches.
+ **/
+static void
+pk_spawn_set_poll (PkSpawn *spawn, guint delay)
+{
+	if (spawn->priv->poll_id != 0)
+		g_source_remove (spawn->priv->poll_id);
+	spawn->priv->poll_id = g_timeout_add (delay, (GSourceFunc) pk_spawn_check_child, spawn);
+	g_source_set_name_by_id (spawn->priv->poll_id, "[PkSpawn] main poll");
+}
+
+/**
+ * pk_spawn_stdout_cb:
+ **/
+static gboolean
+pk_spawn_stdout_cb (GIOChannel *source, GIOCondition condition, PkSpawn *spawn)
+{
+	gboolean ret;
+
+	ret = pk_spawn_read_fd_into_buffer (spawn->priv->stdout_fd,
+					    spawn->priv->stdout_buf);
+	pk_spawn_emit_whole_lines (spawn);
+	if (ret)
+		return TRUE;
+
+	/* the child closed stdout, so it's most likely exiting now */
+	spawn->priv->stdout_id = 0;
+	if (!spawn->priv->finished && pk_spawn_check_child (spawn)) {
+		spawn->priv->exit_retries = PK_SPAWN_EXIT_RETRIES;
+		pk_spawn_set_poll (spawn, PK_SPAWN_EXIT_DELAY);
+	}
+	return FALSE;
+}
+
+/**
+ * pk_spawn_stderr_cb:
+ **/
+static gboolean
+pk_spawn_stderr_cb (GIOChannel *source, GIOCondition condition, PkSpawn *spawn)
+{
+	gboolean ret;
+
+	ret = pk_spawn_read_fd_into_buffer (spawn->priv->stderr_fd,
+					    spawn->priv->stderr_buf);
+	pk_spawn_emit_stderr (spawn);
+	if (ret)
+		return TRUE;
+	spawn->priv->stderr_id = 0;
+	return FALSE;
+}
+
+/**
+ * pk_spawn_add_watch:
+ **/
+static guint
+pk_spawn_add_watch (PkSpawn *spawn, gint fd, GIOFunc func, const gchar *name)
+{
+	GIOChannel *channel;
+	guint id;
+
+	channel = g_io_channel_unix_new (fd);
+	id = g_io_add_watch (channel, G_IO_IN | G_IO_HUP | G_IO_ERR, func, spawn);
+	g_source_set_name_by_id (id, name);
+	g_io_channel_unref (channel);
+	return id;
+}
+
 /**
  * pk_spawn_sigkill_cb:
  **/
@@ -587,10 +718,7 @@ pk_spawn_argv (PkSpawn *spawn, gchar **argv, gchar **envp,
 		if (!ret) {
 			g_warning ("failed to exit previous instance");
 			/* remove poll, as we can't reply on pk_spawn_check_child() */
-			if (spawn->priv->poll_id != 0) {
-				g_source_remove (spawn->priv->poll_id);
-				spawn->priv->poll_id = 0;
-			}
+			pk_spawn_remove_sources (spawn);
 		}
 		spawn->priv->is_changing_dispatcher = FALSE;
 	}
@@ -658,12 +786,20 @@ pk_spawn_argv (PkSpawn *spawn, gchar **argv, gchar **envp,
 	/* sanity check */
 	if (spawn->priv->poll_id != 0) {
 		g_warning ("trying to set timeout when already set");
-		g_source_remove (spawn->priv->poll_id);
+		pk_spawn_remove_sources (spawn);
 	}
 
-	/* poll quickly */
-	spawn->priv->poll_id = g_timeout_add (PK_SPAWN_POLL_DELAY, (GSourceFunc) pk_spawn_check_child, spawn);
-	g_source_set_name_by_id (spawn->priv->poll_id, "[PkSpawn] main poll");
+	/* handle the output as soon as it arrives */
+	spawn->priv->stdout_id = pk_spawn_add_watch (spawn, spawn->priv->stdout_fd,
+						     (GIOFunc) pk_spawn_stdout_cb,
+						     "[PkSpawn] stdout");
+	spawn->priv->stderr_id = pk_spawn_add_watch (spawn, spawn->priv->stderr_fd,
+						     (GIOFunc) pk_spawn_stderr_cb,
+						     "[PkSpawn] stderr");
+
+	/* the child might exit without closing stdout if it forked */
+	spawn->priv->exit_retries = 0;
+	pk_spawn_set_poll (spawn, PK_SPAWN_POLL_DELAY);
 out:
 	return ret;
 }
@@ -777,6 +913,8 @@ pk_spawn_init (PkSpawn *spawn)
 	spawn->priv->stdout_fd = -1;
 	spawn->priv->stderr_fd = -1;
 	spawn->priv->stdin_fd = -1;
+	spawn->priv->stdout_id = 0;
+	spawn->priv->stderr_id = 0;
 	spawn->priv->poll_id = 0;
 	spawn->priv->kill_id = 0;
 	spawn->priv->finished = FALSE;
@@ -809,10 +947,7 @@ pk_spawn_finalize (GObject *object)
 	g_return_if_fail (spawn->priv != NULL);
 
 	/* disconnect the poll in case we were cancelled before completion */
-	if (spawn->priv->poll_id != 0) {
-		g_source_remove (spawn->priv->poll_id);
-		spawn->priv->poll_id = 0;
-	}
+	pk_spawn_remove_sources (spawn);
 
 	/* disconnect the SIGKILL check */
 	if (spawn->priv->kill_id != 0) {
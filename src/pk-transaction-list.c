@@ -83,6 +83,12 @@ static void     pk_transaction_list_finalize	(GObject	*object);
 struct PkTransactionListPrivate
 {
 	GPtrArray		*array;
+	GHashTable		*tids;
+	GHashTable		*uids;
+	GQueue			 ready[2][2];	/* [background][exclusive] */
+	guint			 exclusive_running;
+	guint			 background_running;
+	guint			 seq;
 	guint			 unwedge1_id;
 	guint			 unwedge2_id;
 	GKeyFile		*conf;
@@ -101,7 +107,12 @@ typedef struct {
 	gulong			 finished_id;
 	guint			 uid;
 	guint			 tries;
+	guint			 seq;
 	gboolean		 background;
+	gboolean		 running;
+	gboolean		 running_exclusive;
+	GQueue			*ready_queue;
+	GList			*ready_link;
 } PkTransactionItem;
 
 enum {
@@ -120,23 +131,100 @@ static gpointer pk_transaction_list_object = NULL;
 static PkTransactionItem *
 pk_transaction_list_get_from_tid (PkTransactionList *tlist, const gchar *tid)
 {
-	guint i;
-	GPtrArray *array;
-	PkTransactionItem *item;
-	const gchar *tmptid;
-
 	g_return_val_if_fail (tlist != NULL, NULL);
 	g_return_val_if_fail (PK_IS_TRANSACTION_LIST (tlist), NULL);
 
-	/* find the runner with the transaction ID */
-	array = tlist->priv->array;
-	for (i = 0; i < array->len; i++) {
-		item = (PkTransactionItem *) g_ptr_array_index (array, i);
-		tmptid = pk_transaction_get_tid (item->transaction);
-		if (g_strcmp0 (tmptid, tid) == 0)
-			return item;
+	if (tid == NULL)
+		return NULL;
+	return g_hash_table_lookup (tlist->priv->tids, tid);
+}
+
+/**
+ * pk_transaction_list_item_ready_cmp:
+ **/
+static gint
+pk_transaction_list_item_ready_cmp (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+	const PkTransactionItem *item_a = a;
+	const PkTransactionItem *item_b = b;
+	if (item_a->seq < item_b->seq)
+		return -1;
+	return item_a->seq > item_b->seq;
+}
+
+/**
+ * pk_transaction_list_item_dequeue:
+ *
+ * Removes the item from the ready queue it is waiting in, if any.
+ **/
+static void
+pk_transaction_list_item_dequeue (PkTransactionItem *item)
+{
+	if (item->ready_link == NULL)
+		return;
+	g_queue_delete_link (item->ready_queue, item->ready_link);
+	item->ready_queue = NULL;
+	item->ready_link = NULL;
+}
+
+/**
+ * pk_transaction_list_item_enqueue:
+ *
+ * Adds a ready item to the queue matching its background and exclusive
+ * flags. The queues are kept in the order the transactions were created.
+ **/
+static void
+pk_transaction_list_item_enqueue (PkTransactionItem *item)
+{
+	GQueue *queue;
+	PkTransactionItem *tail;
+	PkTransactionListPrivate *priv = item->list->priv;
+
+	pk_transaction_list_item_dequeue (item);
+	queue = &priv->ready[item->background ? 1 : 0]
+			    [pk_transaction_is_exclusive (item->transaction) ? 1 : 0];
+
+	/* normally the newest, except when retried after a lock error */
+	tail = g_queue_peek_tail (queue);
+	if (tail == NULL || tail->seq < item->seq) {
+		g_queue_push_tail (queue, item);
+		item->ready_link = g_queue_peek_tail_link (queue);
+	} else {
+		g_queue_insert_sorted (queue, item, pk_transaction_list_item_ready_cmp, NULL);
+		item->ready_link = g_queue_find (queue, item);
+	}
+	item->ready_queue = queue;
+}
+
+/**
+ * pk_transaction_list_item_set_running:
+ *
+ * Keeps the counters of running transactions in sync with the item.
+ **/
+static void
+pk_transaction_list_item_set_running (PkTransactionItem *item, gboolean running)
+{
+	PkTransactionListPrivate *priv = item->list->priv;
+
+	if (item->running == running)
+		return;
+	item->running = running;
+	if (running) {
+		pk_transaction_list_item_dequeue (item);
+		if (item->background)
+			priv->background_running++;
+		if (pk_transaction_is_exclusive (item->transaction)) {
+			item->running_exclusive = TRUE;
+			priv->exclusive_running++;
+		}
+	} else {
+		if (item->background)
+			priv->background_running--;
+		if (item->running_exclusive) {
+			item->running_exclusive = FALSE;
+			priv->exclusive_running--;
+		}
 	}
-	return NULL;
 }
 
 /**
@@ -208,6 +296,25 @@ pk_transaction_list_item_free (PkTransactionItem *item)
 	g_free (item);
 }
 
+/**
+ * pk_transaction_list_uid_count_dec:
+ **/
+static void
+pk_transaction_list_uid_count_dec (PkTransactionList *tlist, guint uid)
+{
+	guint count;
+
+	count = GPOINTER_TO_UINT (g_hash_table_lookup (tlist->priv->uids,
+						       GUINT_TO_POINTER (uid)));
+	if (count <= 1) {
+		g_hash_table_remove (tlist->priv->uids, GUINT_TO_POINTER (uid));
+		return;
+	}
+	g_hash_table_insert (tlist->priv->uids,
+			     GUINT_TO_POINTER (uid),
+			     GUINT_TO_POINTER (count - 1));
+}
+
 /**
  * pk_transaction_list_remove_internal:
  **/
@@ -225,6 +332,12 @@ pk_transaction_list_remove_internal (PkTransactionList *tlist, PkTransactionItem
 		g_warning ("could not remove %p as not present in list", item);
 		return FALSE;
 	}
+	g_hash_table_remove (tlist->priv->tids, item->tid);
+	pk_transaction_list_uid_count_dec (tlist, item->uid);
+
+	/* not waiting or running any more */
+	pk_transaction_list_item_dequeue (item);
+	pk_transaction_list_item_set_running (item, FALSE);
 	pk_transaction_list_item_free (item);
 
 	return TRUE;
@@ -298,7 +411,40 @@ pk_transaction_list_set_background (PkTransactionList *tlist,
 		return;
 	}
 	g_debug ("%s is now background: %i", tid, background);
+
+	/* keep the counters and queues right */
+	if (item->running)
+		tlist->priv->background_running += background ? 1 : -1;
 	item->background = background;
+	if (item->ready_link != NULL)
+		pk_transaction_list_item_enqueue (item);
+}
+
+/**
+ * pk_transaction_list_set_exclusive:
+ *
+ * Called when the transaction becomes exclusive, which can happen while
+ * it is already running if the backend takes a lock.
+ **/
+void
+pk_transaction_list_set_exclusive (PkTransactionList *tlist, const gchar *tid)
+{
+	PkTransactionItem *item;
+
+	g_return_if_fail (PK_IS_TRANSACTION_LIST (tlist));
+	g_return_if_fail (tid != NULL);
+
+	/* not managed by us */
+	item = pk_transaction_list_get_from_tid (tlist, tid);
+	if (item == NULL)
+		return;
+
+	if (item->running && !item->running_exclusive) {
+		item->running_exclusive = TRUE;
+		tlist->priv->exclusive_running++;
+	}
+	if (item->ready_link != NULL)
+		pk_transaction_list_item_enqueue (item);
 }
 
 /**
@@ -340,6 +486,7 @@ pk_transaction_list_run_item (PkTransactionList *tlist, PkTransactionItem *item)
 {
 	/* we set this here so that we don't try starting more than one */
 	pk_transaction_set_state (item->transaction, PK_TRANSACTION_STATE_RUNNING);
+	pk_transaction_list_item_set_running (item, TRUE);
 
 	/* add this idle, so that we don't have a deep out-of-order callchain */
 	item->idle_id = g_idle_add ((GSourceFunc) pk_transaction_list_run_idle_cb, item);
@@ -375,72 +522,28 @@ pk_transaction_list_get_active_transactions (PkTransactionList *tlist)
 }
 
 /**
- * pk_transaction_list_get_exclusive_running:
+ * pk_transaction_list_get_next_ready:
  *
- * Return value: Greater than zero if any of the transactions in progress is
- * exclusive (no other exclusive transaction can be run in parallel).
+ * Return value: the oldest ready transaction that can be run now
  **/
-static guint
-pk_transaction_list_get_exclusive_running (PkTransactionList *tlist)
-{
-	PkTransactionItem *item = NULL;
-	GPtrArray *array;
-	guint exclusive_running = 0;
-	guint i;
-
-	g_return_val_if_fail (PK_IS_TRANSACTION_LIST (tlist), FALSE);
-
-	/* anything running? */
-	array = pk_transaction_list_get_active_transactions (tlist);
-	if (array->len == 0)
-		goto out;
-
-	/* check if we have any running locked (exclusive) transaction */
-	for (i = 0; i < array->len; i++) {
-		item = (PkTransactionItem *) g_ptr_array_index (array, i);
-
-		/* check if a transaction is running in exclusive */
-		if (pk_transaction_is_exclusive (item->transaction)) {
-			/* should never be more that one, but we count them for sanity checks */
-			exclusive_running++;
-		}
-	}
-out:
-	g_ptr_array_free (array, TRUE);
-	return exclusive_running;
-}
-
-/**
- * pk_transaction_list_get_background_running:
- *
- * Return value: %TRUE if we have running background transactions
- **/
-static gboolean
-pk_transaction_list_get_background_running (PkTransactionList *tlist)
+static PkTransactionItem *
+pk_transaction_list_get_next_ready (PkTransactionList *tlist, gboolean background)
 {
-	PkTransactionItem *item = NULL;
-	GPtrArray *array;
-	gboolean ret = FALSE;
-	guint i;
-
-	g_return_val_if_fail (PK_IS_TRANSACTION_LIST (tlist), FALSE);
-
-	/* anything running? */
-	array = pk_transaction_list_get_active_transactions (tlist);
-	if (array->len == 0)
-		goto out;
-
-	/* check if we have any running background transaction */
-	for (i = 0; i < array->len; i++) {
-		item = (PkTransactionItem *) g_ptr_array_index (array, i);
-		if (item->background) {
-			ret = TRUE;
-			goto out;
-		}
-	}
-out:
-	g_ptr_array_free (array, TRUE);
-	return ret;
+	PkTransactionItem *exclusive;
+	PkTransactionItem *shared;
+	GQueue *ready = tlist->priv->ready[background ? 1 : 0];
+
+	/* exclusive transactions have to wait for the lock release */
+	shared = g_queue_peek_head (&ready[0]);
+	if (tlist->priv->exclusive_running > 0)
+		return shared;
+
+	exclusive = g_queue_peek_head (&ready[1]);
+	if (shared == NULL)
+		return exclusive;
+	if (exclusive == NULL)
+		return shared;
+	return exclusive->seq < shared->seq ? exclusive : shared;
 }
 
 /**
@@ -449,53 +552,15 @@ out:
 static PkTransactionItem *
 pk_transaction_list_get_next_item (PkTransactionList *tlist)
 {
-	PkTransactionItem *item = NULL;
-	GPtrArray *array;
-	guint i;
-	PkTransactionState state;
-	gboolean exclusive_running;
-
-	array = tlist->priv->array;
-
-	/* check for running exclusive transaction */
-	exclusive_running = pk_transaction_list_get_exclusive_running (tlist) > 0;
+	PkTransactionItem *item;
 
 	/* first try the waiting non-background transactions */
-	for (i = 0; i < array->len; i++) {
-		item = (PkTransactionItem *) g_ptr_array_index (array, i);
-		state = pk_transaction_get_state (item->transaction);
-
-		if ((state == PK_TRANSACTION_STATE_READY) && (!item->background)) {
-			/* check if we can run the transaction now or if we need to wait for lock release */
-			if (pk_transaction_is_exclusive (item->transaction)) {
-				if (!exclusive_running)
-					goto out;
-			} else {
-				goto out;
-			}
-		}
-	}
+	item = pk_transaction_list_get_next_ready (tlist, FALSE);
+	if (item != NULL)
+		return item;
 
 	/* then try the other waiting transactions (background tasks) */
-	for (i = 0; i < array->len; i++) {
-		item = (PkTransactionItem *) g_ptr_array_index (array, i);
-		state = pk_transaction_get_state (item->transaction);
-
-		if (state == PK_TRANSACTION_STATE_READY) {
-			/* check if we can run the transaction now or if we need to wait for lock release */
-			if (pk_transaction_is_exclusive (item->transaction)) {
-				if (!exclusive_running)
-					goto out;
-			} else {
-				goto out;
-			}
-		}
-	}
-
-	/* nothing to run */
-	item = NULL;
-out:
-	return item;
+	return pk_transaction_list_get_next_ready (tlist, TRUE);
 }
 
 /**
@@ -525,6 +590,10 @@ pk_transaction_list_transaction_finished_cb (PkTransaction *transaction,
 		return;
 	}
 
+	/* it might have been cancelled before it was run */
+	pk_transaction_list_item_dequeue (item);
+	pk_transaction_list_item_set_running (item, FALSE);
+
 	if (pk_transaction_is_finished_with_lock_required (item->transaction)) {
 		pk_transaction_reset_after_lock_error (item->transaction);
 
@@ -545,6 +614,9 @@ pk_transaction_list_transaction_finished_cb (PkTransaction *transaction,
 			pk_backend_job_finished (job);
 			return;
 		}
+
+		/* wait for our turn again, now as exclusive */
+		pk_transaction_list_item_enqueue (item);
 	} else {
 		/* we've been 'used' */
 		if (item->commit_id != 0) {
@@ -594,19 +666,8 @@ pk_transaction_list_no_commit_cb (PkTransactionItem *item)
 static guint
 pk_transaction_list_get_number_transactions_for_uid (PkTransactionList *tlist, guint uid)
 {
-	guint i;
-	GPtrArray *array;
-	PkTransactionItem *item;
-	guint count = 0;
-
-	/* find all the transactions in progress */
-	array = tlist->priv->array;
-	for (i = 0; i < array->len; i++) {
-		item = (PkTransactionItem *) g_ptr_array_index (array, i);
-		if (item->uid == uid)
-			count++;
-	}
-	return count;
+	return GPOINTER_TO_UINT (g_hash_table_lookup (tlist->priv->uids,
+						      GUINT_TO_POINTER (uid)));
 }
 
 /**
@@ -638,6 +699,7 @@ pk_transaction_list_create (PkTransactionList *tlist,
 	item = g_new0 (PkTransactionItem, 1);
 	item->list = g_object_ref (tlist);
 	item->tid = g_strdup (tid);
+	item->seq = tlist->priv->seq++;
 	item->transaction = pk_transaction_new (tlist->priv->conf,
 						tlist->priv->introspection);
 	item->finished_id =
@@ -719,6 +781,10 @@ pk_transaction_list_create (PkTransactionList *tlist,
 
 	g_debug ("adding transaction %p", item->transaction);
 	g_ptr_array_add (tlist->priv->array, item);
+	g_hash_table_insert (tlist->priv->tids, item->tid, item);
+	g_hash_table_insert (tlist->priv->uids,
+			     GUINT_TO_POINTER (item->uid),
+			     GUINT_TO_POINTER (count + 1));
 out:
 	return ret;
 }
@@ -864,15 +930,16 @@ pk_transaction_list_commit (PkTransactionList *tlist, const gchar *tid)
 
 	/* is one of the current running transactions background, and this new
 	 * transaction foreground? */
-	if (!item->background && pk_transaction_list_get_background_running (tlist)) {
+	if (!item->background && tlist->priv->background_running > 0) {
 		g_debug ("cancelling running background transactions and instead running %s",
 			item->tid);
 		pk_transaction_list_cancel_background (tlist);
 	}
 
-	/* do the transaction now, if possible */
+	/* do the transaction now, if possible, else wait in the queue */
+	pk_transaction_list_item_enqueue (item);
 	if (pk_transaction_is_exclusive (item->transaction) == FALSE ||
-	    pk_transaction_list_get_exclusive_running (tlist) == 0)
+	    tlist->priv->exclusive_running == 0)
 		pk_transaction_list_run_item (tlist, item);
 
 	return TRUE;
@@ -1049,7 +1116,7 @@ pk_transaction_list_is_consistent (PkTransactionList *tlist)
 	}
 
 	/* more than one exclusive transactions running? */
-	running_exclusive = pk_transaction_list_get_exclusive_running (tlist);
+	running_exclusive = tlist->priv->exclusive_running;
 	if (running_exclusive > 1) {
 		pk_transaction_list_print (tlist);
 		g_warning ("%i exclusive transactions running", running_exclusive);
@@ -1171,6 +1238,12 @@ pk_transaction_list_init (PkTransactionList *tlist)
 {
 	tlist->priv = PK_TRANSACTION_LIST_GET_PRIVATE (tlist);
 	tlist->priv->array = g_ptr_array_new ();
+	tlist->priv->tids = g_hash_table_new (g_str_hash, g_str_equal);
+	tlist->priv->uids = g_hash_table_new (g_direct_hash, g_direct_equal);
+	g_queue_init (&tlist->priv->ready[0][0]);
+	g_queue_init (&tlist->priv->ready[0][1]);
+	g_queue_init (&tlist->priv->ready[1][0]);
+	g_queue_init (&tlist->priv->ready[1][1]);
 	tlist->priv->introspection = pk_load_introspection (PK_DBUS_INTERFACE_TRANSACTION ".xml",
 							    NULL);
 	tlist->priv->unwedge2_id = 0;
@@ -1201,6 +1274,12 @@ pk_transaction_list_finalize (GObject *object)
 
 	g_ptr_array_foreach (tlist->priv->array, (GFunc) pk_transaction_list_item_free, NULL);
 	g_ptr_array_free (tlist->priv->array, TRUE);
+	g_hash_table_unref (tlist->priv->tids);
+	g_hash_table_unref (tlist->priv->uids);
+	g_queue_clear (&tlist->priv->ready[0][0]);
+	g_queue_clear (&tlist->priv->ready[0][1]);
+	g_queue_clear (&tlist->priv->ready[1][0]);
+	g_queue_clear (&tlist->priv->ready[1][1]);
 	g_dbus_node_info_unref (tlist->priv->introspection);
 	g_key_file_unref (tlist->priv->conf);
 	if (tlist->priv->plugins != NULL)
@@ -63,6 +63,8 @@ gboolean	 pk_transaction_list_remove		(PkTransactionList	*tlist,
 void		 pk_transaction_list_set_background	(PkTransactionList	*tlist,
 							 const gchar		*tid,
 							 gboolean		 background);
+void		 pk_transaction_list_set_exclusive	(PkTransactionList	*tlist,
+							 const gchar		*tid);
 gboolean	 pk_transaction_list_commit		(PkTransactionList	*tlist,
 							 const gchar		*tid)
 							 G_GNUC_WARN_UNUSED_RESULT;
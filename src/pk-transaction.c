@@ -89,6 +89,7 @@ struct PkTransactionPrivate
 	gboolean		 exclusive;
 	PkHintEnum		 background;
 	PkHintEnum		 interactive;
+	gboolean		 packages_signal;
 	gchar			*locale;
 	gchar			*frontend_socket;
 	guint			 cache_age;
@@ -586,7 +587,7 @@ pk_transaction_error_code_cb (PkBackendJob *job,
 	if (!transaction->priv->exclusive && code == PK_ERROR_ENUM_LOCK_REQUIRED) {
 		/* the backend failed to get lock for this action, this means this transaction has to be run in exclusive mode */
 		g_debug ("changing transaction to exclusive mode (after failing with lock-required)");
-		transaction->priv->exclusive = TRUE;
+		pk_transaction_make_exclusive (transaction);
 	} else {
 		/* emit, as it is not the internally-handled LOCK_REQUIRED code */
 		pk_transaction_error_code_emit (transaction, code, details);
@@ -1303,26 +1304,17 @@ pk_transaction_finished_cb (PkBackendJob *job, PkExitEnum exit_enum, PkTransacti
 }
 
 /**
- * pk_transaction_package_cb:
+ * pk_transaction_package_add:
+ *
+ * Checks the package and adds it to the results.
+ *
+ * Return value: %TRUE if the package should be emitted
  **/
-static void
-pk_transaction_package_cb (PkBackend *backend,
-			   PkPackage *item,
-			   PkTransaction *transaction)
+static gboolean
+pk_transaction_package_add (PkTransaction *transaction, PkPackage *item)
 {
 	const gchar *role_text;
 	PkInfoEnum info;
-	const gchar *package_id;
-	const gchar *summary = NULL;
-
-	g_return_if_fail (PK_IS_TRANSACTION (transaction));
-	g_return_if_fail (transaction->priv->tid != NULL);
-
-	/* have we already been marked as finished? */
-	if (transaction->priv->finished) {
-		g_warning ("Already finished");
-		return;
-	}
 
 	/* check the backend is doing the right thing */
 	info = pk_package_get_info (item);
@@ -1332,7 +1324,7 @@ pk_transaction_package_cb (PkBackend *backend,
 			role_text = pk_role_enum_to_string (transaction->priv->role);
 			g_warning ("%s emitted 'installed' rather than 'installing'",
 				   role_text);
-			return;
+			return FALSE;
 		}
 	}
 
@@ -1344,7 +1336,7 @@ pk_transaction_package_cb (PkBackend *backend,
 			g_warning ("%s emitted package that was installed when "
 				   "the ~installed filter is in place",
 				   role_text);
-			return;
+			return FALSE;
 		}
 	}
 	if (pk_bitfield_contain (transaction->priv->cached_filters,
@@ -1354,7 +1346,7 @@ pk_transaction_package_cb (PkBackend *backend,
 			g_warning ("%s emitted package that was ~installed when "
 				   "the installed filter is in place",
 				   role_text);
-			return;
+			return FALSE;
 		}
 	}
 
@@ -1362,29 +1354,117 @@ pk_transaction_package_cb (PkBackend *backend,
 	if (info != PK_INFO_ENUM_FINISHED)
 		pk_results_add_package (transaction->priv->results, item);
 
-	/* emit */
-	package_id = pk_package_get_id (item);
 	g_free (transaction->priv->last_package_id);
-	transaction->priv->last_package_id = g_strdup (package_id);
-	summary = pk_package_get_summary (item);
+	transaction->priv->last_package_id = g_strdup (pk_package_get_id (item));
 	if (transaction->priv->role != PK_ROLE_ENUM_GET_PACKAGES) {
 		g_debug ("emit package %s, %s, %s",
 			 pk_info_enum_to_string (info),
-			 package_id,
-			 summary);
+			 pk_package_get_id (item),
+			 pk_package_get_summary (item));
 	}
+	return TRUE;
+}
+
+/**
+ * pk_transaction_package_emit:
+ **/
+static void
+pk_transaction_package_emit (PkTransaction *transaction, PkPackage *item)
+{
+	const gchar *summary;
+
+	summary = pk_package_get_summary (item);
 	g_dbus_connection_emit_signal (transaction->priv->connection,
 				       NULL,
 				       transaction->priv->tid,
 				       PK_DBUS_INTERFACE_TRANSACTION,
 				       "Package",
 				       g_variant_new ("(uss)",
-						      info,
-						      package_id,
+						      pk_package_get_info (item),
+						      pk_package_get_id (item),
 						      summary ? summary : ""),
 				       NULL);
 }
 
+/**
+ * pk_transaction_package_cb:
+ **/
+static void
+pk_transaction_package_cb (PkBackend *backend,
+			   PkPackage *item,
+			   PkTransaction *transaction)
+{
+	g_return_if_fail (PK_IS_TRANSACTION (transaction));
+	g_return_if_fail (transaction->priv->tid != NULL);
+
+	/* have we already been marked as finished? */
+	if (transaction->priv->finished) {
+		g_warning ("Already finished");
+		return;
+	}
+
+	/* emit */
+	if (pk_transaction_package_add (transaction, item))
+		pk_transaction_package_emit (transaction, item);
+}
+
+/**
+ * pk_transaction_packages_cb:
+ *
+ * Emits a chunk of packages as one Packages signal if the client
+ * asked for it, or as one Package signal each otherwise.
+ **/
+static void
+pk_transaction_packages_cb (PkBackend *backend,
+			    GPtrArray *array,
+			    PkTransaction *transaction)
+{
+	const gchar *summary;
+	guint i;
+	guint len = 0;
+	GVariantBuilder builder;
+	PkPackage *item;
+
+	g_return_if_fail (PK_IS_TRANSACTION (transaction));
+	g_return_if_fail (transaction->priv->tid != NULL);
+
+	/* have we already been marked as finished? */
+	if (transaction->priv->finished) {
+		g_warning ("Already finished");
+		return;
+	}
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(uss)"));
+	for (i = 0; i < array->len; i++) {
+		item = g_ptr_array_index (array, i);
+		if (!pk_transaction_package_add (transaction, item))
+			continue;
+		if (!transaction->priv->packages_signal) {
+			pk_transaction_package_emit (transaction, item);
+			continue;
+		}
+		summary = pk_package_get_summary (item);
+		g_variant_builder_add (&builder, "(uss)",
+				       pk_package_get_info (item),
+				       pk_package_get_id (item),
+				       summary ? summary : "");
+		len++;
+	}
+
+	/* nothing to send */
+	if (len == 0) {
+		g_variant_builder_clear (&builder);
+		return;
+	}
+	g_dbus_connection_emit_signal (transaction->priv->connection,
+				       NULL,
+				       transaction->priv->tid,
+				       PK_DBUS_INTERFACE_TRANSACTION,
+				       "Packages",
+				       g_variant_new ("(a(uss))", &builder),
+				       NULL);
+}
+
 /**
  * pk_transaction_repo_detail_cb:
  **/
@@ -1913,6 +1993,10 @@ pk_transaction_signals_reset (PkTransaction *transaction,
 				  PK_BACKEND_SIGNAL_PACKAGE,
 				  (PkBackendJobVFunc) pk_transaction_package_cb,
 				  transaction);
+	pk_backend_job_set_vfunc (job,
+				  PK_BACKEND_SIGNAL_PACKAGES,
+				  (PkBackendJobVFunc) pk_transaction_packages_cb,
+				  transaction);
 	pk_backend_job_set_vfunc (job,
 				  PK_BACKEND_SIGNAL_ITEM_PROGRESS,
 				  (PkBackendJobVFunc) pk_transaction_item_progress_cb,
@@ -2308,6 +2392,12 @@ pk_transaction_make_exclusive (PkTransaction *transaction)
 	g_debug ("changing transaction to exclusive mode");
 
 	transaction->priv->exclusive = TRUE;
+
+	/* this changes what else can be run */
+	if (transaction->priv->tid != NULL) {
+		pk_transaction_list_set_exclusive (transaction->priv->transaction_list,
+						   transaction->priv->tid);
+	}
 }
 
 /**
@@ -4504,7 +4594,7 @@ out:
 /**
  * pk_transaction_refresh_cache:
  **/
-static void
+void
 pk_transaction_refresh_cache (PkTransaction *transaction,
 			      GVariant *params,
 			      GDBusMethodInvocation *context)
@@ -5242,6 +5332,24 @@ pk_transaction_set_hint (PkTransaction *transaction,
 		goto out;
 	}
 
+	/* packages-signal=true */
+	if (g_strcmp0 (key, "packages-signal") == 0) {
+		switch (pk_hint_enum_from_string (value)) {
+		case PK_HINT_ENUM_TRUE:
+			priv->packages_signal = TRUE;
+			break;
+		case PK_HINT_ENUM_FALSE:
+			priv->packages_signal = FALSE;
+			break;
+		default:
+			g_set_error (error, PK_TRANSACTION_ERROR, PK_TRANSACTION_ERROR_NOT_SUPPORTED,
+				     "packages-signal hint expects true or false, not %s", value);
+			ret = FALSE;
+			break;
+		}
+		goto out;
+	}
+
 	/* cache-age=<time-in-seconds> */
 	if (g_strcmp0 (key, "cache-age") == 0) {
 		ret = pk_strtouint (value, &priv->cache_age);